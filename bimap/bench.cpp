@@ -0,0 +1,1432 @@
+#include "bimap.h"
+#include "compact_bimap.h"
+#include "concurrent_bimap.h"
+#include "lru_bimap.h"
+#include "mapped_bimap.h"
+#include "persistent_bimap.h"
+#include "sharded_bimap.h"
+#include "unordered_bimap.h"
+#include <algorithm>
+#include <array>
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using int_bimap = bimap<int, int>;
+
+static constexpr uint32_t seed = 1488228;
+
+// Бимапы большого размера строятся долго, поэтому кешируем их между запусками.
+int_bimap const &prepared(size_t n) {
+  static std::map<size_t, std::unique_ptr<int_bimap>> cache;
+  auto &ptr = cache[n];
+  if (!ptr) {
+    ptr = std::make_unique<int_bimap>();
+    std::mt19937 e(seed);
+    while (ptr->size() < n) {
+      ptr->insert(static_cast<int>(e()), static_cast<int>(e()));
+    }
+  }
+  return *ptr;
+}
+
+// Прежняя реализация: бинарный поиск по итераторам, O(n) переходов на запрос.
+int_bimap::left_iterator iterator_lower_bound(int_bimap const &b, int key) {
+  size_t dist = b.size();
+  auto first = b.begin_left();
+  while (dist > 0) {
+    auto it = first;
+    auto hop = dist / 2;
+    for (size_t i = 0; i < hop; i++) {
+      ++it;
+    }
+    if (*it < key) {
+      first = ++it;
+      dist -= hop + 1;
+    } else {
+      dist = hop;
+    }
+  }
+  return first;
+}
+
+void BM_lower_bound_descent(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  std::mt19937 e(seed + 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(b.lower_bound_left(static_cast<int>(e())));
+  }
+}
+
+void BM_lower_bound_iterator_walk(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  std::mt19937 e(seed + 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(iterator_lower_bound(b, static_cast<int>(e())));
+  }
+}
+
+std::vector<std::pair<int, int>> sorted_pairs(size_t n) {
+  std::vector<std::pair<int, int>> data(n);
+  std::vector<int> rights(n);
+  for (size_t i = 0; i < n; i++) {
+    rights[i] = static_cast<int>(i);
+  }
+  std::shuffle(rights.begin(), rights.end(), std::mt19937(seed));
+  for (size_t i = 0; i < n; i++) {
+    data[i] = {static_cast<int>(i), rights[i]};
+  }
+  return data;
+}
+
+void BM_build_insert(benchmark::State &state) {
+  auto data = sorted_pairs(state.range(0));
+  for (auto _ : state) {
+    int_bimap b;
+    for (auto const &p : data) {
+      b.insert(p.first, p.second);
+    }
+    benchmark::DoNotOptimize(b.size());
+  }
+  state.SetItemsProcessed(state.iterations() * data.size());
+}
+
+// Каждый поток строит свою, независимую бимапу.
+void BM_build_insert_parallel(benchmark::State &state) {
+  auto data = sorted_pairs(state.range(0));
+  for (auto _ : state) {
+    int_bimap b;
+    for (auto const &p : data) {
+      b.insert(p.first, p.second);
+    }
+    benchmark::DoNotOptimize(b.size());
+  }
+  state.SetItemsProcessed(state.iterations() * data.size());
+  state.counters["node_bytes"] =
+      benchmark::Counter(sizeof(int_bimap::node_heavy), benchmark::Counter::kAvgThreads);
+}
+
+void BM_build_sorted(benchmark::State &state) {
+  auto data = sorted_pairs(state.range(0));
+  for (auto _ : state) {
+    int_bimap b(data.begin(), data.end());
+    benchmark::DoNotOptimize(b.size());
+  }
+  state.SetItemsProcessed(state.iterations() * data.size());
+}
+
+size_t allocation_count = 0;
+size_t allocated_bytes = 0;
+
+// std::allocator, считающий обращения к себе и выданные байты.
+template<typename T>
+struct counting_allocator : std::allocator<T> {
+  counting_allocator() = default;
+
+  template<typename U>
+  counting_allocator(counting_allocator<U> const &) noexcept {}
+
+  template<typename U>
+  struct rebind {
+    using other = counting_allocator<U>;
+  };
+
+  T *allocate(size_t n) {
+    allocation_count++;
+    allocated_bytes += n * sizeof(T);
+    return std::allocator<T>::allocate(n);
+  }
+};
+
+// Вставка и удаление вперемешку при фиксированном размере бимапы.
+template<typename Bimap>
+void churn(benchmark::State &state, Bimap &b) {
+  size_t n = state.range(0);
+  std::mt19937 e(seed);
+  std::vector<int> keys;
+  while (keys.size() < n) {
+    int key = static_cast<int>(e());
+    if (b.insert(key, key) != b.end_left()) {
+      keys.push_back(key);
+    }
+  }
+  size_t pos = 0;
+  for (auto _ : state) {
+    b.erase_left(keys[pos]);
+    int key = static_cast<int>(e());
+    while (b.insert(key, key) == b.end_left()) {
+      key = static_cast<int>(e());
+    }
+    keys[pos] = key;
+    pos = (pos + 1) % n;
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+
+void BM_insert_erase_churn(benchmark::State &state) {
+  int_bimap b;
+  churn(state, b);
+}
+
+void BM_insert_erase_churn_allocations(benchmark::State &state) {
+  bimap<int, int, std::less<int>, std::less<int>, counting_allocator<std::pair<int, int>>> b;
+  allocation_count = 0;
+  churn(state, b);
+  state.counters["allocs_per_op"] =
+      static_cast<double>(allocation_count) / (state.iterations() * 2 + state.range(0));
+}
+
+void BM_compact_insert_erase_churn(benchmark::State &state) {
+  compact_bimap<int, int> b;
+  churn(state, b);
+}
+
+// Цена политики statistics на той же нагрузке; счетчики выводятся рядом.
+void BM_counted_insert_erase_churn(benchmark::State &state) {
+  bimap<int, int, std::less<int>, std::less<int>, std::allocator<std::pair<int, int>>,
+        bimap_statistics_policy> b;
+  churn(state, b);
+  auto stats = b.stats();
+  state.counters["cmp_per_op"] = stats.comparisons_per_operation();
+  state.counters["max_depth"] = static_cast<double>(stats.left.max_depth);
+  state.counters["avg_depth"] = stats.left.average_depth;
+}
+
+// Кеш на n пар, запросы к 2n ключам: примерно половина промахов,
+// каждый промах вытесняет самую давнюю пару.
+void BM_lru_lookup_or_insert(benchmark::State &state) {
+  int n = static_cast<int>(state.range(0));
+  lru_bimap<int, int> cache(n);
+  std::mt19937 e(seed);
+  for (auto _ : state) {
+    int key = static_cast<int>(e() % (2 * n));
+    if (cache.find_left(key) == cache.end_left()) {
+      cache.insert(key, -key);
+    }
+  }
+}
+
+// То же на bimap с внешним списком давности и хеш-таблицей итераторов.
+void BM_external_lru_lookup_or_insert(benchmark::State &state) {
+  int n = static_cast<int>(state.range(0));
+  int_bimap cache;
+  std::list<int> recency;
+  std::unordered_map<int, std::list<int>::iterator> position;
+  std::mt19937 e(seed);
+  for (auto _ : state) {
+    int key = static_cast<int>(e() % (2 * n));
+    if (cache.find_left(key) != cache.end_left()) {
+      recency.splice(recency.end(), recency, position[key]);
+      continue;
+    }
+    if (cache.size() == static_cast<size_t>(n)) {
+      cache.erase_left(recency.front());
+      position.erase(recency.front());
+      recency.pop_front();
+    }
+    cache.insert(key, -key);
+    position[key] = recency.insert(recency.end(), key);
+  }
+}
+
+std::vector<std::uint32_t> distinct_keys(size_t n) {
+  std::vector<std::uint32_t> keys(n);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = static_cast<std::uint32_t>(i);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(seed));
+  return keys;
+}
+
+// Память на пару <uint32_t, uint32_t> вместе с резервом пула.
+void BM_bytes_per_pair(benchmark::State &state) {
+  auto keys = distinct_keys(state.range(0));
+  size_t bytes = 0;
+  for (auto _ : state) {
+    allocated_bytes = 0;
+    bimap<std::uint32_t, std::uint32_t, std::less<std::uint32_t>, std::less<std::uint32_t>,
+          counting_allocator<std::pair<std::uint32_t, std::uint32_t>>> b;
+    for (size_t i = 0; i < keys.size(); i++) {
+      b.insert(keys[i], keys[keys.size() - 1 - i]);
+    }
+    bytes = allocated_bytes;
+  }
+  state.counters["bytes_per_pair"] = static_cast<double>(bytes) / keys.size();
+}
+
+void BM_compact_bytes_per_pair(benchmark::State &state) {
+  auto keys = distinct_keys(state.range(0));
+  size_t bytes = 0;
+  for (auto _ : state) {
+    compact_bimap<std::uint32_t, std::uint32_t> b;
+    for (size_t i = 0; i < keys.size(); i++) {
+      b.insert(keys[i], keys[keys.size() - 1 - i]);
+    }
+    bytes = b.memory_usage();
+  }
+  state.counters["bytes_per_pair"] = static_cast<double>(bytes) / keys.size();
+}
+
+using ranked_bimap = bimap<int, int, std::less<int>, std::less<int>,
+                           std::allocator<std::pair<int, int>>,
+                           bimap_order_statistics_policy>;
+
+// Страница из 100 элементов по правой стороне, начиная с середины.
+void BM_page_walk_from_begin(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  for (auto _ : state) {
+    auto it = b.begin_right();
+    for (size_t i = 0; i < b.size() / 2; i++) {
+      ++it;
+    }
+    for (int i = 0; i < 100; i++, ++it) {
+      benchmark::DoNotOptimize(*it);
+    }
+  }
+}
+
+void BM_page_nth(benchmark::State &state) {
+  ranked_bimap b;
+  std::mt19937 e(seed);
+  while (b.size() < static_cast<size_t>(state.range(0))) {
+    b.insert(static_cast<int>(e()), static_cast<int>(e()));
+  }
+  for (auto _ : state) {
+    auto it = b.nth_right(b.size() / 2);
+    for (int i = 0; i < 100; i++, ++it) {
+      benchmark::DoNotOptimize(*it);
+    }
+  }
+}
+
+// Микробенчмарки ядра treap'а: размер бимапы задается аргументом.
+void BM_treap_insert(benchmark::State &state) {
+  size_t n = state.range(0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    {
+      int_bimap b;
+      std::mt19937 e(seed);
+      state.ResumeTiming();
+      for (size_t i = 0; i < n; i++) {
+        b.insert(static_cast<int>(e()), static_cast<int>(e()));
+      }
+      state.PauseTiming();
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+void BM_treap_erase(benchmark::State &state) {
+  size_t n = state.range(0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    {
+      int_bimap b;
+      std::mt19937 e(seed);
+      std::vector<int> keys;
+      keys.reserve(n);
+      while (keys.size() < n) {
+        int key = static_cast<int>(e());
+        if (b.insert(key, key) != b.end_left()) {
+          keys.push_back(key);
+        }
+      }
+      std::shuffle(keys.begin(), keys.end(), e);
+      state.ResumeTiming();
+      for (int key : keys) {
+        b.erase_left(key);
+      }
+      state.PauseTiming();
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Как BM_treap_erase, но итераторы найдены заранее.
+void BM_erase_iterator(benchmark::State &state) {
+  size_t n = state.range(0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    {
+      int_bimap b;
+      std::mt19937 e(seed);
+      std::vector<int_bimap::left_iterator> its;
+      its.reserve(n);
+      while (its.size() < n) {
+        int key = static_cast<int>(e());
+        auto it = b.insert(key, key);
+        if (it != b.end_left()) {
+          its.push_back(it);
+        }
+      }
+      std::shuffle(its.begin(), its.end(), e);
+      state.ResumeTiming();
+      for (auto it : its) {
+        b.erase_left(it);
+      }
+      state.PauseTiming();
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Удаление диапазона с половиной ключей.
+void BM_erase_range(benchmark::State &state) {
+  size_t n = state.range(0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    {
+      int_bimap b;
+      std::mt19937 e(seed);
+      while (b.size() < n) {
+        b.insert(static_cast<int>(e()), static_cast<int>(e()));
+      }
+      auto first = b.lower_bound_left(std::numeric_limits<int>::min() / 2);
+      auto last = b.lower_bound_left(std::numeric_limits<int>::max() / 2);
+      state.ResumeTiming();
+      b.erase_left(first, last);
+      state.PauseTiming();
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * n / 2);
+}
+
+void BM_treap_find(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  std::mt19937 e(seed);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(b.find_left(static_cast<int>(e())));
+  }
+}
+
+// int в структуре: Treap::exists для арифметических ключей идет своим
+// путем (два сравнения на уровень), для остальных -- одним сравнением.
+// Пара BM_treap_find_key<int> и <boxed_int> сравнивает эти два спуска
+// на одинаковых данных.
+struct boxed_int {
+  int value;
+  friend bool operator<(boxed_int a, boxed_int b) noexcept {
+    return a.value < b.value;
+  }
+};
+
+template<typename Key>
+void BM_treap_find_key(benchmark::State &state) {
+  size_t n = state.range(0);
+  bimap<Key, int> b;
+  std::mt19937 e(seed);
+  while (b.size() < n) {
+    b.insert(Key{static_cast<int>(e())}, static_cast<int>(e()));
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(b.find_left(Key{static_cast<int>(e())}));
+  }
+}
+
+// Поиск по std::string_view: с std::less<std::string> нужна временная
+// строка, с прозрачным std::less<> ключ сравнивается как есть.
+template<typename Compare>
+void BM_find_left_string_view(benchmark::State &state) {
+  size_t n = state.range(0);
+  bimap<std::string, int, Compare> b;
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < n; i++) {
+    keys.push_back("left-key-padded-past-small-string-" + std::to_string(i));
+    b.insert(keys.back(), static_cast<int>(i));
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(seed));
+  size_t i = 0;
+  for (auto _ : state) {
+    std::string_view key = keys[i];
+    if constexpr (std::is_same_v<Compare, std::less<>>) {
+      benchmark::DoNotOptimize(b.find_left(key));
+    } else {
+      benchmark::DoNotOptimize(b.find_left(std::string(key)));
+    }
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+}
+
+// Поиск существующих ключей в случайном порядке: дерево против хеш-таблицы.
+std::vector<int> lookup_keys(size_t n) {
+  std::vector<int> keys;
+  keys.reserve(n);
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < n; i++) {
+    keys.push_back(static_cast<int>(e()));
+  }
+  return keys;
+}
+
+template<typename Map>
+void BM_find_left_hit(benchmark::State &state) {
+  size_t n = state.range(0);
+  auto keys = lookup_keys(n);
+  Map b;
+  for (int key : keys) {
+    b.insert(key, key);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(seed + 1));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(b.find_left(keys[i]));
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+}
+
+// Читатели общего bimap на миллион пар: снимок без блокировок против
+// bimap под мьютексом. Общие данные строятся один раз на все потоки.
+constexpr size_t shared_pairs = 1000000;
+
+concurrent_bimap<int, int> const &shared_concurrent() {
+  static concurrent_bimap<int, int> b;
+  static std::once_flag built;
+  std::call_once(built, [] {
+    b.update([](auto &m) {
+      for (int key : lookup_keys(shared_pairs)) {
+        m.insert(key, key);
+      }
+    });
+  });
+  return b;
+}
+
+template<typename Find>
+void shared_reads(benchmark::State &state, Find find) {
+  auto keys = lookup_keys(shared_pairs);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(seed + state.thread_index()));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(find(keys[i]));
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_concurrent_find_left(benchmark::State &state) {
+  auto const &b = shared_concurrent();
+  shared_reads(state, [&](int key) { return b.find_left(key); });
+}
+
+// Одиночные изменения с публикацией: удаление и вставка в bimap из n пар.
+void BM_concurrent_insert_erase(benchmark::State &state) {
+  size_t n = state.range(0);
+  concurrent_bimap<int, int> b;
+  auto keys = lookup_keys(n);
+  b.update([&](auto &m) {
+    for (int key : keys) {
+      m.insert(key, key);
+    }
+  });
+  std::mt19937 e(seed);
+  size_t pos = 0;
+  for (auto _ : state) {
+    b.erase_left(keys[pos]);
+    int key = static_cast<int>(e());
+    while (!b.insert(key, key)) {
+      key = static_cast<int>(e());
+    }
+    keys[pos] = key;
+    pos = (pos + 1) % n;
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+
+void BM_mutex_find_left(benchmark::State &state) {
+  static std::mutex lock;
+  static int_bimap const b = [] {
+    int_bimap res;
+    for (int key : lookup_keys(shared_pairs)) {
+      res.insert(key, key);
+    }
+    return res;
+  }();
+  shared_reads(state, [&](int key) {
+    std::lock_guard<std::mutex> guard(lock);
+    return *b.find_left(key).flip();
+  });
+}
+
+// Пропускная способность вставок из многих потоков: шарды против одного
+// bimap под мьютексом. Каждый поток вставляет свои ключи.
+template<typename Insert>
+void shared_inserts(benchmark::State &state, Insert insert) {
+  int thread = state.thread_index();
+  int i = 0;
+  for (auto _ : state) {
+    int key = (i++ << 6) | thread;
+    benchmark::DoNotOptimize(insert(key, -key - 1));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_sharded_insert(benchmark::State &state) {
+  static std::unique_ptr<sharded_bimap<int, int>> b;
+  if (state.thread_index() == 0) {
+    b = std::make_unique<sharded_bimap<int, int>>(state.range(0));
+  }
+  shared_inserts(state, [](int l, int r) { return b->insert(l, r); });
+  if (state.thread_index() == 0) {
+    b.reset();
+  }
+}
+
+void BM_mutex_insert(benchmark::State &state) {
+  static std::mutex lock;
+  static std::unique_ptr<int_bimap> b;
+  if (state.thread_index() == 0) {
+    b = std::make_unique<int_bimap>();
+  }
+  shared_inserts(state, [](int l, int r) {
+    std::lock_guard<std::mutex> guard(lock);
+    return b->insert(l, r) != b->end_left();
+  });
+  if (state.thread_index() == 0) {
+    b.reset();
+  }
+}
+
+void BM_frozen_find_left_hit(benchmark::State &state) {
+  size_t n = state.range(0);
+  auto keys = lookup_keys(n);
+  int_bimap b;
+  for (int key : keys) {
+    b.insert(key, key);
+  }
+  auto f = b.freeze();
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(seed + 1));
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(f.find_left(keys[i]));
+    if (++i == keys.size()) {
+      i = 0;
+    }
+  }
+}
+
+void BM_frozen_lower_bound(benchmark::State &state) {
+  auto f = prepared(state.range(0)).freeze();
+  std::mt19937 e(seed);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(f.lower_bound_left(static_cast<int>(e())));
+  }
+}
+
+void BM_frozen_iterate(benchmark::State &state) {
+  auto f = prepared(state.range(0)).freeze();
+  for (auto _ : state) {
+    long long sum = 0;
+    for (auto it = f.begin_left(); it != f.end_left(); ++it) {
+      sum += *it.flip();
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * f.size());
+}
+
+void BM_treap_iterate(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  for (auto _ : state) {
+    long long sum = 0;
+    for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+      sum += *it.flip();
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * b.size());
+}
+
+// Крайние элементы обеих сторон, как в циклах, которые каждый раз
+// берут begin() и --end().
+void BM_begin_end(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(*b.begin_left());
+    benchmark::DoNotOptimize(*std::prev(b.end_left()));
+    benchmark::DoNotOptimize(*b.begin_right());
+    benchmark::DoNotOptimize(*std::prev(b.end_right()));
+  }
+}
+
+// Файлы для mapped_bimap пишутся один раз на размер.
+std::string const &saved(size_t n) {
+  static std::map<size_t, std::string> cache;
+  auto &path = cache[n];
+  if (path.empty()) {
+    path = "/tmp/bimap_bench_" + std::to_string(n) + ".bin";
+    save_bimap(prepared(n), path);
+  }
+  return path;
+}
+
+// Запуск процесса: открыть файл и ответить на первый запрос.
+void BM_mapped_open(benchmark::State &state) {
+  auto const &path = saved(state.range(0));
+  std::mt19937 e(seed);
+  for (auto _ : state) {
+    mapped_bimap<int, int> m(path);
+    benchmark::DoNotOptimize(m.find_left(static_cast<int>(e())));
+  }
+}
+
+// То же без файла: собрать bimap из отсортированных пар.
+void BM_open_by_rebuild(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  std::vector<std::pair<int, int>> pairs;
+  for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+    pairs.emplace_back(*it, *it.flip());
+  }
+  for (auto _ : state) {
+    int_bimap rebuilt(pairs.begin(), pairs.end());
+    benchmark::DoNotOptimize(rebuilt.find_left(pairs[0].first));
+  }
+}
+
+void BM_mapped_lower_bound(benchmark::State &state) {
+  mapped_bimap<int, int> m(saved(state.range(0)));
+  std::mt19937 e(seed);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m.lower_bound_left(static_cast<int>(e())));
+  }
+}
+
+void BM_copy(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  for (auto _ : state) {
+    int_bimap copy(b);
+    benchmark::DoNotOptimize(copy.size());
+    state.PauseTiming();
+    copy.clear();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * b.size());
+}
+
+persistent_bimap<int, int> prepared_persistent(size_t n) {
+  persistent_bimap<int, int> res;
+  std::mt19937 e(seed);
+  while (res.size() < n) {
+    res.insert(static_cast<int>(e()), static_cast<int>(e()));
+  }
+  return res;
+}
+
+// Снимок persistent_bimap против копии bimap (BM_copy).
+void BM_persistent_snapshot(benchmark::State &state) {
+  auto const b = prepared_persistent(state.range(0));
+  for (auto _ : state) {
+    auto snap = b.snapshot();
+    benchmark::DoNotOptimize(snap.size());
+  }
+}
+
+// Замена пары; при range(1) = 1 перед каждой заменой берется снимок,
+// и изменение копирует пути в обоих деревьях.
+void BM_persistent_churn(benchmark::State &state) {
+  auto b = prepared_persistent(state.range(0));
+  std::vector<int> keys(b.begin_left(), b.end_left());
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(seed + 1));
+  std::mt19937 e(seed + 2);
+  persistent_bimap<int, int> snap;
+  size_t pos = 0;
+  for (auto _ : state) {
+    if (state.range(1) != 0) {
+      snap = b.snapshot();
+    }
+    b.erase_left(keys[pos]);
+    int key = static_cast<int>(e());
+    while (!b.insert(key, key)) {
+      key = static_cast<int>(e());
+    }
+    keys[pos] = key;
+    pos = (pos + 1) % keys.size();
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+
+// Прежний конструктор копирования: вставка пар по одной.
+void BM_copy_by_insert(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  for (auto _ : state) {
+    int_bimap copy;
+    for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+      copy.insert(*it, *it.flip());
+    }
+    benchmark::DoNotOptimize(copy.size());
+    state.PauseTiming();
+    copy.clear();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * b.size());
+}
+
+// Перезагрузка конфигурации: копия поверх старой версии того же размера.
+void BM_copy_assign(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  int_bimap target(b);
+  for (auto _ : state) {
+    target = b;
+    benchmark::DoNotOptimize(target.size());
+  }
+  state.SetItemsProcessed(state.iterations() * b.size());
+}
+
+void BM_move_assign(benchmark::State &state) {
+  auto const &b = prepared(state.range(0));
+  int_bimap target(b);
+  int_bimap source(b);
+  for (auto _ : state) {
+    target = std::move(source);
+    benchmark::DoNotOptimize(target.size());
+  }
+}
+
+// Пачка из m новых пар в bimap из n пар: по одной и через insert_batch.
+std::vector<std::pair<int, int>> fresh_batch(size_t m) {
+  std::vector<std::pair<int, int>> batch;
+  std::mt19937 e(seed + 2);
+  for (size_t i = 0; i < m; i++) {
+    batch.emplace_back(static_cast<int>(e()), static_cast<int>(e()));
+  }
+  return batch;
+}
+
+void BM_batch_by_insert(benchmark::State &state) {
+  auto const &base = prepared(state.range(0));
+  auto batch = fresh_batch(state.range(1));
+  for (auto _ : state) {
+    state.PauseTiming();
+    int_bimap b(base);
+    state.ResumeTiming();
+    for (auto const &p : batch) {
+      b.insert(p.first, p.second);
+    }
+    benchmark::DoNotOptimize(b.size());
+    state.PauseTiming();
+    b.clear();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * batch.size());
+}
+
+void BM_insert_batch(benchmark::State &state) {
+  auto const &base = prepared(state.range(0));
+  auto batch = fresh_batch(state.range(1));
+  for (auto _ : state) {
+    state.PauseTiming();
+    int_bimap b(base);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(b.insert_batch(batch.begin(), batch.end()));
+    state.PauseTiming();
+    b.clear();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * batch.size());
+}
+
+// Вчерашняя и сегодняшняя версии: половина пар общая.
+std::pair<int_bimap, int_bimap> two_versions(size_t n) {
+  std::pair<int_bimap, int_bimap> res;
+  std::mt19937 e(seed);
+  while (res.first.size() < n) {
+    int l = static_cast<int>(e()), r = static_cast<int>(e());
+    res.first.insert(l, r);
+    if (e() % 2 == 0) {
+      res.second.insert(l, r);
+    } else {
+      res.second.insert(static_cast<int>(e()), static_cast<int>(e()));
+    }
+  }
+  return res;
+}
+
+void BM_union(benchmark::State &state) {
+  auto versions = two_versions(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(bimap_union(versions.first, versions.second).size());
+  }
+}
+
+// Прежний способ: копия и вставка по одной.
+void BM_union_by_loop(benchmark::State &state) {
+  auto versions = two_versions(state.range(0));
+  for (auto _ : state) {
+    int_bimap res(versions.first);
+    for (auto it = versions.second.begin_left(); it != versions.second.end_left(); ++it) {
+      res.insert(*it, *it.flip());
+    }
+    benchmark::DoNotOptimize(res.size());
+  }
+}
+
+void BM_intersection(benchmark::State &state) {
+  auto versions = two_versions(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(bimap_intersection(versions.first, versions.second).size());
+  }
+}
+
+void BM_intersection_by_loop(benchmark::State &state) {
+  auto versions = two_versions(state.range(0));
+  for (auto _ : state) {
+    int_bimap res;
+    for (auto it = versions.first.begin_left(); it != versions.first.end_left(); ++it) {
+      auto found = versions.second.find_left(*it);
+      if (found != versions.second.end_left() && *found.flip() == *it.flip()) {
+        res.insert(*it, *it.flip());
+      }
+    }
+    benchmark::DoNotOptimize(res.size());
+  }
+}
+
+using string_bimap = bimap<std::string, std::string>;
+
+// Шард с n парами длинных строк, которые не влезают в SSO.
+string_bimap string_shard(size_t n) {
+  string_bimap res;
+  for (size_t i = 0; i < n; i++) {
+    auto key = std::to_string(i);
+    res.insert("left-key-padded-past-small-string-" + key, "right-key-padded-past-small-string-" + key);
+  }
+  return res;
+}
+
+// Каждая итерация перекладывает все пары в другой шард.
+void BM_rebalance_by_erase_insert(benchmark::State &state) {
+  size_t n = state.range(0);
+  string_bimap from = string_shard(n), to;
+  for (auto _ : state) {
+    while (!from.empty()) {
+      auto it = from.begin_left();
+      to.insert(*it, *it.flip());
+      from.erase_left(it);
+    }
+    std::swap(from, to);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+void BM_rebalance_by_extract(benchmark::State &state) {
+  size_t n = state.range(0);
+  string_bimap from = string_shard(n), to;
+  for (auto _ : state) {
+    while (!from.empty()) {
+      to.insert(from.extract_left(from.begin_left()));
+    }
+    std::swap(from, to);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Поток из n пар с n / 16 различными ключами: почти все пары отвергаются.
+template<typename Key>
+std::vector<Key> duplicate_stream(size_t n) {
+  std::mt19937 e(seed);
+  std::vector<Key> res;
+  for (size_t i = 0; i < n; i++) {
+    auto key = e() % (n / 16);
+    if constexpr (std::is_same_v<Key, std::string>) {
+      res.push_back("key-padded-past-small-string-" + std::to_string(key));
+    } else {
+      res.push_back(static_cast<Key>(key));
+    }
+  }
+  return res;
+}
+
+template<typename Key>
+void BM_insert_duplicates(benchmark::State &state) {
+  auto stream = duplicate_stream<Key>(state.range(0));
+  for (auto _ : state) {
+    bimap<Key, Key> b;
+    for (auto const &key : stream) {
+      b.insert(key, key);
+    }
+    benchmark::DoNotOptimize(b.size());
+  }
+  state.SetItemsProcessed(state.iterations() * stream.size());
+}
+
+// range(1) != 0: right тоже по возрастанию, иначе перемешан.
+std::vector<std::pair<int, int>> ascending_pairs(benchmark::State const &state) {
+  if (state.range(1) == 0) {
+    return sorted_pairs(state.range(0));
+  }
+  std::vector<std::pair<int, int>> data(state.range(0));
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = {static_cast<int>(i), static_cast<int>(i)};
+  }
+  return data;
+}
+
+void BM_insert_sorted(benchmark::State &state) {
+  auto pairs = ascending_pairs(state);
+  for (auto _ : state) {
+    int_bimap b;
+    for (auto const &p : pairs) {
+      b.insert(p.first, p.second);
+    }
+    benchmark::DoNotOptimize(b.size());
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+void BM_insert_sorted_hint(benchmark::State &state) {
+  auto pairs = ascending_pairs(state);
+  for (auto _ : state) {
+    int_bimap b;
+    for (auto const &p : pairs) {
+      b.insert(b.end_left(), b.end_right(), p.first, p.second);
+    }
+    benchmark::DoNotOptimize(b.size());
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+void BM_treap_destroy(benchmark::State &state) {
+  size_t n = state.range(0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto b = std::make_unique<int_bimap>();
+    std::mt19937 e(seed);
+    while (b->size() < n) {
+      b->insert(static_cast<int>(e()), static_cast<int>(e()));
+    }
+    state.ResumeTiming();
+    b.reset();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Набор сравнительных замеров: bimap против пары std::map на одних и тех
+// же данных. Имена вида suite/<нагрузка>/<реализация>/<ключ>/<n>, их удобно
+// выбирать фильтром (--benchmark_filter=^suite/) и сравнивать между
+// версиями по JSON-выводу, см. цель bimap_bench_json.
+
+// 64-байтный ключ с длинным общим префиксом: сравнение -- memcmp всего ключа.
+struct key64 {
+  std::array<unsigned char, 64> bytes;
+
+  friend bool operator<(key64 const &a, key64 const &b) {
+    return std::memcmp(a.bytes.data(), b.bytes.data(), a.bytes.size()) < 0;
+  }
+};
+
+// Ключ по номеру, порядок ключей совпадает с порядком номеров.
+template<typename Key>
+Key make_key(uint32_t i) {
+  if constexpr (std::is_same_v<Key, int>) {
+    return static_cast<int>(i);
+  } else if constexpr (std::is_same_v<Key, std::string>) {
+    // Длиннее SSO-буфера, чтобы строки жили в куче.
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "key-%020u", i);
+    return buf;
+  } else {
+    key64 key;
+    key.bytes.fill('k');
+    for (size_t b = 0; b < 4; b++) {
+      key.bytes[key.bytes.size() - 1 - b] = static_cast<unsigned char>(i >> (8 * b));
+    }
+    return key;
+  }
+}
+
+// Левые ключи -- четные номера, правые -- перестановка тех же номеров,
+// промахи -- нечетные номера между ними.
+template<typename Key>
+struct suite_input {
+  std::vector<std::pair<Key, Key>> random;
+  std::vector<std::pair<Key, Key>> sorted;
+  std::vector<Key> hits;
+  std::vector<Key> misses;
+};
+
+template<typename Key>
+suite_input<Key> const &suite_data(size_t n) {
+  static std::map<size_t, std::unique_ptr<suite_input<Key>>> cache;
+  auto &ptr = cache[n];
+  if (!ptr) {
+    ptr = std::make_unique<suite_input<Key>>();
+    std::mt19937 e(seed);
+    std::vector<uint32_t> order(n);
+    for (size_t i = 0; i < n; i++) {
+      order[i] = static_cast<uint32_t>(i);
+    }
+    std::vector<uint32_t> rights = order;
+    std::shuffle(rights.begin(), rights.end(), e);
+    for (size_t i = 0; i < n; i++) {
+      ptr->sorted.emplace_back(make_key<Key>(2 * order[i]), make_key<Key>(2 * rights[i]));
+    }
+    ptr->random = ptr->sorted;
+    std::shuffle(ptr->random.begin(), ptr->random.end(), e);
+    std::shuffle(order.begin(), order.end(), e);
+    for (uint32_t i : order) {
+      ptr->hits.push_back(make_key<Key>(2 * i));
+      ptr->misses.push_back(make_key<Key>(2 * i + 1));
+    }
+  }
+  return *ptr;
+}
+
+template<typename Key>
+struct suite_bimap {
+  using key_type = Key;
+
+  bimap<Key, Key> b;
+
+  bool insert(Key const &left, Key const &right) {
+    return b.insert(left, right) != b.end_left();
+  }
+
+  bool contains_left(Key const &left) const {
+    return b.find_left(left) != b.end_left();
+  }
+
+  bool lower_bound_left(Key const &left) const {
+    return b.lower_bound_left(left) != b.end_left();
+  }
+
+  bool erase_left(Key const &left) {
+    return b.erase_left(left);
+  }
+
+  template<typename F>
+  void for_each_left(F &&f) const {
+    for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+      f(*it);
+    }
+  }
+
+  size_t size() const {
+    return b.size();
+  }
+};
+
+// Эталон: два std::map, каждый хранит копию ключа другой стороны.
+template<typename Key>
+struct suite_two_maps {
+  using key_type = Key;
+
+  std::map<Key, Key> left;
+  std::map<Key, Key> right;
+
+  bool insert(Key const &l, Key const &r) {
+    if (left.count(l) != 0 || right.count(r) != 0) {
+      return false;
+    }
+    left.emplace(l, r);
+    right.emplace(r, l);
+    return true;
+  }
+
+  bool contains_left(Key const &l) const {
+    return left.find(l) != left.end();
+  }
+
+  bool lower_bound_left(Key const &l) const {
+    return left.lower_bound(l) != left.end();
+  }
+
+  bool erase_left(Key const &l) {
+    auto it = left.find(l);
+    if (it == left.end()) {
+      return false;
+    }
+    right.erase(it->second);
+    left.erase(it);
+    return true;
+  }
+
+  template<typename F>
+  void for_each_left(F &&f) const {
+    for (auto const &p : left) {
+      f(p.first);
+    }
+  }
+
+  size_t size() const {
+    return left.size();
+  }
+};
+
+template<typename Impl>
+Impl const &suite_prepared(size_t n) {
+  static std::map<size_t, std::unique_ptr<Impl>> cache;
+  auto &ptr = cache[n];
+  if (!ptr) {
+    ptr = std::make_unique<Impl>();
+    for (auto const &p : suite_data<typename Impl::key_type>(n).random) {
+      ptr->insert(p.first, p.second);
+    }
+  }
+  return *ptr;
+}
+
+// Построение с нуля; разрушение готового контейнера не замеряется.
+template<typename Impl, bool sorted>
+void BM_suite_insert(benchmark::State &state) {
+  auto const &data = suite_data<typename Impl::key_type>(state.range(0));
+  auto const &pairs = sorted ? data.sorted : data.random;
+  for (auto _ : state) {
+    auto c = std::make_unique<Impl>();
+    for (auto const &p : pairs) {
+      c->insert(p.first, p.second);
+    }
+    benchmark::DoNotOptimize(c->size());
+    state.PauseTiming();
+    c.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+template<typename Impl, bool hit>
+void BM_suite_find(benchmark::State &state) {
+  auto const &c = suite_prepared<Impl>(state.range(0));
+  auto const &data = suite_data<typename Impl::key_type>(state.range(0));
+  auto const &keys = hit ? data.hits : data.misses;
+  size_t pos = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(c.contains_left(keys[pos]));
+    pos = pos + 1 == keys.size() ? 0 : pos + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Границы запрашиваются по отсутствующим ключам.
+template<typename Impl>
+void BM_suite_lower_bound(benchmark::State &state) {
+  auto const &c = suite_prepared<Impl>(state.range(0));
+  auto const &keys = suite_data<typename Impl::key_type>(state.range(0)).misses;
+  size_t pos = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(c.lower_bound_left(keys[pos]));
+    pos = pos + 1 == keys.size() ? 0 : pos + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Удаление всех пар в случайном порядке из копии, снятой вне замера.
+template<typename Impl>
+void BM_suite_erase(benchmark::State &state) {
+  auto const &prepared = suite_prepared<Impl>(state.range(0));
+  auto const &keys = suite_data<typename Impl::key_type>(state.range(0)).hits;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto c = std::make_unique<Impl>(prepared);
+    state.ResumeTiming();
+    for (auto const &key : keys) {
+      c->erase_left(key);
+    }
+    benchmark::DoNotOptimize(c->size());
+    state.PauseTiming();
+    c.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template<typename Impl>
+void BM_suite_iterate(benchmark::State &state) {
+  auto const &c = suite_prepared<Impl>(state.range(0));
+  for (auto _ : state) {
+    c.for_each_left([](auto const &key) {
+      benchmark::DoNotOptimize(&key);
+    });
+  }
+  state.SetItemsProcessed(state.iterations() * c.size());
+}
+
+template<typename Impl>
+void BM_suite_copy(benchmark::State &state) {
+  auto const &prepared = suite_prepared<Impl>(state.range(0));
+  for (auto _ : state) {
+    auto c = std::make_unique<Impl>(prepared);
+    benchmark::DoNotOptimize(c->size());
+    state.PauseTiming();
+    c.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * prepared.size());
+}
+
+template<typename Impl>
+void BM_suite_destroy(benchmark::State &state) {
+  auto const &prepared = suite_prepared<Impl>(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto c = std::make_unique<Impl>(prepared);
+    state.ResumeTiming();
+    c.reset();
+  }
+  state.SetItemsProcessed(state.iterations() * prepared.size());
+}
+
+template<typename Impl>
+void register_suite(std::string const &impl, std::string const &key) {
+  auto add = [&](std::string const &workload, void (*f)(benchmark::State &)) {
+    benchmark::RegisterBenchmark(("suite/" + workload + "/" + impl + "/" + key).c_str(), f)
+        ->RangeMultiplier(10)
+        ->Range(1000, 1000000);
+  };
+  add("insert_random", BM_suite_insert<Impl, false>);
+  add("insert_sorted", BM_suite_insert<Impl, true>);
+  add("find_hit", BM_suite_find<Impl, true>);
+  add("find_miss", BM_suite_find<Impl, false>);
+  add("lower_bound", BM_suite_lower_bound<Impl>);
+  add("erase", BM_suite_erase<Impl>);
+  add("iterate", BM_suite_iterate<Impl>);
+  add("copy", BM_suite_copy<Impl>);
+  add("destroy", BM_suite_destroy<Impl>);
+}
+
+template<typename Key>
+void register_suite(std::string const &key) {
+  register_suite<suite_bimap<Key>>("bimap", key);
+  register_suite<suite_two_maps<Key>>("two_maps", key);
+}
+
+bool const suite_registered = [] {
+  register_suite<int>("int");
+  register_suite<std::string>("string");
+  register_suite<key64>("key64");
+  return true;
+}();
+
+} // namespace
+
+BENCHMARK(BM_lower_bound_descent)->RangeMultiplier(10)->Range(1000, 10000000);
+BENCHMARK(BM_lower_bound_iterator_walk)
+    ->RangeMultiplier(10)
+    ->Range(1000, 10000000)
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_build_insert)
+    ->RangeMultiplier(10)
+    ->Range(1000, 1000000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_build_insert_parallel)
+    ->Arg(100000)
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_build_sorted)
+    ->RangeMultiplier(10)
+    ->Range(1000, 1000000)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_insert_erase_churn)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_insert_erase_churn_allocations)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_compact_insert_erase_churn)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_counted_insert_erase_churn)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_lru_lookup_or_insert)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_external_lru_lookup_or_insert)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_bytes_per_pair)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_compact_bytes_per_pair)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_page_walk_from_begin)
+    ->RangeMultiplier(10)
+    ->Range(1000, 1000000)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_page_nth)
+    ->RangeMultiplier(10)
+    ->Range(1000, 1000000)
+    ->Unit(benchmark::kMicrosecond);
+
+// 100M пар требуют около 7 GB памяти.
+BENCHMARK(BM_treap_insert)
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_treap_erase)
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_erase_iterator)
+    ->RangeMultiplier(10)
+    ->Range(1000, 10000000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_treap_find)->RangeMultiplier(10)->Range(1000, 100000000);
+BENCHMARK_TEMPLATE(BM_treap_find_key, int)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK_TEMPLATE(BM_treap_find_key, boxed_int)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_treap_destroy)
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000000)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(BM_find_left_hit, int_bimap)->RangeMultiplier(10)->Range(1000, 10000000);
+BENCHMARK_TEMPLATE(BM_find_left_hit, compact_bimap<int, int>)->RangeMultiplier(10)->Range(1000, 10000000);
+BENCHMARK_TEMPLATE(BM_find_left_hit, unordered_bimap<int, int>)->RangeMultiplier(10)->Range(1000, 10000000);
+BENCHMARK(BM_concurrent_find_left)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_mutex_find_left)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_concurrent_insert_erase)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_sharded_insert)->Arg(64)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK(BM_mutex_insert)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK(BM_frozen_find_left_hit)->RangeMultiplier(10)->Range(1000, 10000000);
+BENCHMARK(BM_frozen_lower_bound)->RangeMultiplier(10)->Range(1000, 10000000);
+BENCHMARK(BM_treap_iterate)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_begin_end)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_frozen_iterate)->RangeMultiplier(10)->Range(1000, 1000000);
+
+BENCHMARK(BM_mapped_open)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_open_by_rebuild)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_mapped_lower_bound)->RangeMultiplier(10)->Range(1000, 10000000);
+
+BENCHMARK(BM_persistent_snapshot)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_persistent_churn)->ArgsProduct({{1000, 100000, 1000000}, {0, 1}});
+BENCHMARK(BM_copy)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_copy_by_insert)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_copy_assign)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_move_assign)->RangeMultiplier(10)->Range(1000, 1000000);
+
+BENCHMARK(BM_batch_by_insert)
+    ->ArgsProduct({{1000000}, {10000, 100000, 1000000}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_insert_batch)
+    ->ArgsProduct({{1000000}, {10000, 100000, 1000000}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_union)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_union_by_loop)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_intersection)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_intersection_by_loop)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_rebalance_by_erase_insert)->RangeMultiplier(10)->Range(1000, 100000);
+BENCHMARK(BM_rebalance_by_extract)->RangeMultiplier(10)->Range(1000, 100000);
+
+BENCHMARK_TEMPLATE(BM_insert_duplicates, int)->RangeMultiplier(10)->Range(10000, 1000000);
+BENCHMARK_TEMPLATE(BM_insert_duplicates, std::string)->RangeMultiplier(10)->Range(10000, 1000000);
+BENCHMARK(BM_insert_sorted)->ArgsProduct({{10000, 100000, 1000000}, {0, 1}});
+BENCHMARK(BM_insert_sorted_hint)->ArgsProduct({{10000, 100000, 1000000}, {0, 1}});
+
+BENCHMARK(BM_erase_range)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_TEMPLATE(BM_find_left_string_view, std::less<std::string>)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK_TEMPLATE(BM_find_left_string_view, std::less<>)->RangeMultiplier(10)->Range(1000, 1000000);
+
+BENCHMARK_MAIN();
@@ -1,15 +1,84 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <utility>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
 #include <random>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <vector>
 
+#include "frozen_bimap.h"
+
+
+// Compile-time политики bimap. Свою политику удобно наследовать
+// от bimap_default_policy и переопределять только нужные поля.
+struct bimap_default_policy {
+    // Хранить в узлах размеры поддеревьев: nth/rank и distance/advance
+    // по итераторам за O(log n) ценой size_t на каждую сторону узла.
+    static constexpr bool order_statistics = false;
+
+    // Считать сравнения, узлы, split/merge и операции, см. bimap::stats().
+    // Без нее счетчиков нет ни в bimap, ни в компараторах деревьев.
+    static constexpr bool statistics = false;
+
+    // Дополнительная база узла пары, например хук интрузивного списка
+    // (см. lru_bimap). Пустая база места в узле не занимает.
+    struct node_hook {
+    };
+};
+
+struct bimap_order_statistics_policy : bimap_default_policy {
+    static constexpr bool order_statistics = true;
+};
+
+struct bimap_statistics_policy : bimap_default_policy {
+    static constexpr bool statistics = true;
+};
+
+// Счетчики bimap с политикой statistics, снимок -- см. bimap::stats().
+// Принадлежат объекту bimap: копирование и перемещение их не переносят.
+struct bimap_counters {
+    // Одиночные вставки, удаления и extract, поиски, bounds и equal_range.
+    size_t operations = 0;
+    // Вызовы компараторов обеих сторон.
+    size_t comparisons = 0;
+    // Узлы, выданные пулом и возвращенные в него.
+    size_t allocations = 0;
+    size_t frees = 0;
+    size_t splits = 0;
+    size_t merges = 0;
+};
+
+// Форма одного treap'а. Глубина корня 0, depth_histogram[d] -- число узлов на глубине d.
+struct bimap_tree_stats {
+    size_t max_depth = 0;
+    double average_depth = 0;
+    std::vector<size_t> depth_histogram;
+};
+
+// Снимок статистики, см. bimap::stats().
+struct bimap_stats : bimap_counters {
+    bimap_tree_stats left;
+    bimap_tree_stats right;
+
+    double comparisons_per_operation() const noexcept {
+        return operations == 0 ? 0 : static_cast<double>(comparisons) / static_cast<double>(operations);
+    }
+};
 
 template<typename Left, typename Right, typename CompareLeft = std::less<Left>,
-        typename CompareRight = std::less<Right>>
+        typename CompareRight = std::less<Right>, typename Allocator = std::allocator<std::pair<Left, Right>>,
+        typename Policy = bimap_default_policy>
 struct bimap {
 
     using left_t = Left;
@@ -21,20 +90,33 @@ struct bimap {
     struct tag_value {
     };
 
+    static constexpr bool order_statistics = Policy::order_statistics;
+    static constexpr bool statistics = Policy::statistics;
+
+    struct no_subtree_size {
+    };
+
+    struct subtree_size {
+        size_t size = 1;
+    };
+
     template<typename T, typename side>
-    struct node_light {
+    struct node_light : std::conditional_t<order_statistics, subtree_size, no_subtree_size> {
         node_light *left = nullptr;
         node_light *right = nullptr;
         node_light *parent = nullptr;
-        T data;
-        long long priority = rand();
+        // Ключ создает и разрушает node_heavy, у заголовка дерева ключа нет.
+        union {
+            T data;
+        };
 
         explicit node_light(const T &val) noexcept: data(val) {};
 
         explicit node_light(T &&val) noexcept: data(std::move(val)) {};
 
+        node_light() noexcept {}
 
-        node_light() = default;
+        ~node_light() {}
 
         node_light<T, side> *next() noexcept {
             auto temp = this;
@@ -45,7 +127,9 @@ struct bimap {
                 }
                 return temp;
             }
-            while (temp->parent != nullptr && temp->parent->left != temp) {
+            // Корень -- левый ребенок заголовка, подъем от максимума
+            // заканчивается в заголовке, то есть в end().
+            while (temp->parent->left != temp) {
                 temp = temp->parent;
             }
             return temp->parent;
@@ -69,369 +153,1992 @@ struct bimap {
 
     };
 
-    struct node_heavy : node_light<Left, tag_key>, node_light<Right, tag_value> {
-        node_heavy(left_t key, right_t value) noexcept: node_light<Left, tag_key>(std::move(key)),
-                                                        node_light<Right, tag_value>(std::move(value)) {}
+    // Приоритет один на пару: оба treap'а используют его.
+    struct node_heavy : node_light<Left, tag_key>, node_light<Right, tag_value>, Policy::node_hook {
+        std::uint32_t priority;
+
+        node_heavy(std::uint32_t priority, left_t key, right_t value) noexcept
+                : node_light<Left, tag_key>(std::move(key)), node_light<Right, tag_value>(std::move(value)),
+                  priority(priority) {}
+
+        ~node_heavy() {
+            node_light<Left, tag_key>::data.~Left();
+            node_light<Right, tag_value>::data.~Right();
+        }
+    };
+
+private:
+    // xorshift64*: приоритеты без глобального состояния rand().
+    struct priority_generator {
+        std::uint64_t state;
+
+        explicit priority_generator(std::uint64_t seed) noexcept: state(mix(seed)) {}
+
+        std::uint32_t operator()() noexcept {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return static_cast<std::uint32_t>((state * 0x2545F4914F6CDD1DULL) >> 32);
+        }
+
+        // splitmix64, чтобы близкие seed'ы давали разные последовательности
+        // и состояние никогда не было нулевым.
+        static std::uint64_t mix(std::uint64_t x) noexcept {
+            x += 0x9E3779B97F4A7C15ULL;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            x ^= x >> 31;
+            return x != 0 ? x : 1;
+        }
+    };
+
+    union node_slot {
+        node_slot *next;
+        alignas(node_heavy) unsigned char storage[sizeof(node_heavy)];
+    };
+
+    using slot_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<node_slot>;
+    using slot_traits = std::allocator_traits<slot_allocator>;
+
+    // Счетчики statistics. Атомарные: bimap_union и другие операции над
+    // множествами работают в нескольких потоках, а const-поиски в общем
+    // bimap тоже могут идти параллельно. Порядок не нужен, только суммы.
+    struct shared_counters {
+        std::atomic<size_t> operations{0};
+        std::atomic<size_t> comparisons{0};
+        std::atomic<size_t> allocations{0};
+        std::atomic<size_t> frees{0};
+        std::atomic<size_t> splits{0};
+        std::atomic<size_t> merges{0};
+
+        void add(std::atomic<size_t> shared_counters::*counter) noexcept {
+            (this->*counter).fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bimap_counters load() const noexcept {
+            bimap_counters res;
+            res.operations = operations.load(std::memory_order_relaxed);
+            res.comparisons = comparisons.load(std::memory_order_relaxed);
+            res.allocations = allocations.load(std::memory_order_relaxed);
+            res.frees = frees.load(std::memory_order_relaxed);
+            res.splits = splits.load(std::memory_order_relaxed);
+            res.merges = merges.load(std::memory_order_relaxed);
+            return res;
+        }
+
+        void reset() noexcept {
+            for (auto counter : {&shared_counters::operations, &shared_counters::comparisons,
+                                 &shared_counters::allocations, &shared_counters::frees,
+                                 &shared_counters::splits, &shared_counters::merges}) {
+                (this->*counter).store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    struct counted {
+        mutable shared_counters counters;
+    };
+
+    struct uncounted {
+    };
+
+    // Узлы нарезаются из слэбов, полученных у аллокатора. Освобожденные
+    // узлы попадают во free list и переиспользуются, слэбы возвращаются
+    // аллокатору только в release_all. Пустой пул ничего не аллоцирует.
+    // Пул заодно хранит счетчики; без статистики база пуста.
+    struct node_pool : slot_allocator, std::conditional_t<statistics, counted, uncounted> {
+        struct slab_header {
+            node_slot *next_slab;
+            size_t size;
+        };
+
+        static_assert(sizeof(slab_header) <= sizeof(node_slot));
+
+        static constexpr size_t min_slab = 8;
+        static constexpr size_t max_slab = 4096;
+
+        struct anchor;
+
+        node_slot *free_list = nullptr;
+        node_slot *cursor = nullptr;
+        node_slot *cursor_end = nullptr;
+        node_slot *slabs = nullptr;
+        size_t capacity = 0;
+        size_t spare = 0;
+        anchor *shared = nullptr;
+
+        explicit node_pool(const slot_allocator &alloc) noexcept: slot_allocator(alloc) {}
+
+        node_pool(node_pool &&other) noexcept: slot_allocator(std::move(other.get_allocator())) {
+            steal(other);
+        }
+
+        node_pool &operator=(node_pool const &) = delete;
+
+        ~node_pool() {
+            release_all();
+        }
+
+        slot_allocator &get_allocator() noexcept {
+            return *this;
+        }
+
+        const slot_allocator &get_allocator() const noexcept {
+            return *this;
+        }
+
+        template<typename... Args>
+        node_heavy *create(Args &&... args) {
+            node_slot *s = take();
+            try {
+                node_heavy *node = new(s->storage) node_heavy(std::forward<Args>(args)...);
+                if constexpr (statistics) {
+                    this->counters.add(&shared_counters::allocations);
+                }
+                return node;
+            } catch (...) {
+                give_back(s);
+                throw;
+            }
+        }
+
+        void destroy(node_heavy *node) noexcept {
+            if constexpr (statistics) {
+                this->counters.add(&shared_counters::frees);
+            }
+            node->~node_heavy();
+            give_back(reinterpret_cast<node_slot *>(node));
+        }
+
+        // Вынутый узел (см. node_type) остается в своем слоте. Handle держит
+        // anchor пула: через него слот возвращается в пул, а если пул
+        // разрушен или отдал слэбы, anchor владеет этими слэбами, пока жив
+        // хотя бы один handle. Создается при первом extract, один на пул.
+        struct anchor {
+            slot_allocator alloc;
+            node_pool *pool;
+            node_slot *slabs = nullptr;
+            size_t handles = 0;
+        };
+
+        using anchor_allocator = typename slot_traits::template rebind_alloc<anchor>;
+        using anchor_traits = std::allocator_traits<anchor_allocator>;
+
+        // Может бросить только при первом вызове.
+        anchor *get_anchor() {
+            if (shared == nullptr) {
+                anchor_allocator alloc(get_allocator());
+                anchor *a = anchor_traits::allocate(alloc, 1);
+                shared = new(a) anchor{get_allocator(), this};
+            }
+            return shared;
+        }
+
+        // Слот вынутого узла больше не нужен: он возвращается в пул или,
+        // без пула, разрушается вместе с последним handle'ом anchor'а.
+        static void release_detached(anchor *a, node_heavy *node) noexcept {
+            a->handles--;
+            if (a->pool != nullptr) {
+                a->pool->destroy(node);
+                return;
+            }
+            node->~node_heavy();
+            if (a->handles == 0) {
+                free_slabs(a->alloc, a->slabs);
+                free_anchor(a);
+            }
+        }
+
+        // Гарантирует, что следующие n вызовов create не пойдут к аллокатору.
+        void reserve(size_t n) {
+            if (n > spare) {
+                add_slab(n - spare);
+            }
+        }
+
+        // Слэбы с вынутыми узлами переходят к anchor'у.
+        void release_all() noexcept {
+            if (shared != nullptr && shared->handles != 0) {
+                shared->pool = nullptr;
+                shared->slabs = std::exchange(slabs, nullptr);
+                shared = nullptr;
+            }
+            if (shared != nullptr) {
+                free_anchor(std::exchange(shared, nullptr));
+            }
+            free_slabs(get_allocator(), std::exchange(slabs, nullptr));
+            free_list = cursor = cursor_end = nullptr;
+            capacity = spare = 0;
+        }
+
+        // Обмен слэбами без обмена аллокаторами: они должны быть равны.
+        void swap_slabs(node_pool &other) noexcept {
+            std::swap(free_list, other.free_list);
+            std::swap(cursor, other.cursor);
+            std::swap(cursor_end, other.cursor_end);
+            std::swap(slabs, other.slabs);
+            std::swap(capacity, other.capacity);
+            std::swap(spare, other.spare);
+            std::swap(shared, other.shared);
+            rebind_anchor();
+            other.rebind_anchor();
+        }
+
+        // Забирает слэбы other; аллокаторы должны быть равны.
+        void steal(node_pool &other) noexcept {
+            free_list = std::exchange(other.free_list, nullptr);
+            cursor = std::exchange(other.cursor, nullptr);
+            cursor_end = std::exchange(other.cursor_end, nullptr);
+            slabs = std::exchange(other.slabs, nullptr);
+            capacity = std::exchange(other.capacity, 0);
+            spare = std::exchange(other.spare, 0);
+            shared = std::exchange(other.shared, nullptr);
+            rebind_anchor();
+        }
+
+    private:
+        void rebind_anchor() noexcept {
+            if (shared != nullptr) {
+                shared->pool = this;
+            }
+        }
+
+        static void free_slabs(slot_allocator &alloc, node_slot *slab) noexcept {
+            while (slab != nullptr) {
+                auto header = reinterpret_cast<slab_header *>(slab);
+                node_slot *next = header->next_slab;
+                slot_traits::deallocate(alloc, slab, header->size);
+                slab = next;
+            }
+        }
+
+        static void free_anchor(anchor *a) noexcept {
+            anchor_allocator alloc(a->alloc);
+            a->~anchor();
+            anchor_traits::deallocate(alloc, a, 1);
+        }
+
+        node_slot *take() {
+            if (free_list != nullptr) {
+                spare--;
+                return std::exchange(free_list, free_list->next);
+            }
+            if (cursor == cursor_end) {
+                add_slab(std::min(std::max(capacity, min_slab), max_slab));
+            }
+            spare--;
+            return cursor++;
+        }
+
+        void give_back(node_slot *s) noexcept {
+            s->next = free_list;
+            free_list = s;
+            spare++;
+        }
+
+        void add_slab(size_t n) {
+            node_slot *slab = slot_traits::allocate(get_allocator(), n + 1);
+            while (cursor != cursor_end) {
+                give_back(cursor++);
+                spare--;
+            }
+            new(slab->storage) slab_header{slabs, n + 1};
+            slabs = slab;
+            cursor = slab + 1;
+            cursor_end = slab + n + 1;
+            capacity += n;
+            spare += n;
+        }
+    };
+
+    // Компаратор деревьев со статистикой: считает свои вызовы в счетчики
+    // bimap, адрес которых выставляет bind_stats. Временные деревья,
+    // построенные от компаратора bimap, считают туда же. Компаратор --
+    // поле, как в Treap: указатель на функцию и final-тип тоже подходят.
+    template<typename Compare>
+    struct counting_compare {
+        Compare cmp = Compare();
+        shared_counters *counters = nullptr;
+
+        counting_compare() = default;
+
+        counting_compare(const Compare &cmp) : cmp(cmp) {}
+
+        template<typename A, typename B>
+        bool operator()(A const &a, B const &b) const {
+            if (counters != nullptr) {
+                counters->add(&shared_counters::comparisons);
+            }
+            return cmp(a, b);
+        }
     };
 
+public:
+    // Заголовок дерева -- узел без ключа, он же end(): header.left -- корень,
+    // header.right -- максимум, parent пуст только у заголовка. Минимум
+    // хранится рядом в leftmost, для пустого дерева это заголовок.
+    // Операции над поддеревьями (split, merge, unite, filter) работают
+    // с отцепленными деревьями, у корня которых parent пуст; результат
+    // подвешивается к заголовку через set_root.
     template<typename T, typename side, typename Compare>
     struct Treap {
     public:
         using node_t = node_light<T, side> *;
-        node_t root = nullptr;
-        Compare cmp = Compare();
+        using compare_type = std::conditional_t<statistics, counting_compare<Compare>, Compare>;
+        node_light<T, side> header;
+        node_t leftmost = &header;
+        compare_type cmp = compare_type();
 
-        Treap(Treap &&other) noexcept {
-            std::swap(root, other.root);
+        node_t root() const noexcept {
+            return header.left;
         }
 
+        node_t end() const noexcept {
+            return const_cast<node_t>(&header);
+        }
 
-        Treap& operator=(const Treap& other) = default;
+        node_t or_end(node_t node) const noexcept {
+            return node != nullptr ? node : end();
+        }
 
-        node_t merge(node_t t1, node_t t2) noexcept {
-            if (t1 == nullptr) {
-                return t2;
+        static node_t min_node(node_t t) noexcept {
+            while (t->left != nullptr) {
+                t = t->left;
             }
-            if (t2 == nullptr) {
-                return t1;
+            return t;
+        }
+
+        static node_t max_node(node_t t) noexcept {
+            while (t->right != nullptr) {
+                t = t->right;
             }
-            if (t1->priority > t2->priority) {
-                t1->right = merge(t1->right, t2);
-                t1->right->parent = t1;
-                return t1;
+            return t;
+        }
+
+        // Подвешивает отцепленное дерево t к заголовку и находит крайние узлы.
+        void set_root(node_t t) noexcept {
+            header.left = t;
+            if (t != nullptr) {
+                t->parent = &header;
+                leftmost = min_node(t);
+                header.right = max_node(t);
             } else {
-                t2->left = merge(t1, t2->left);
-                t2->left->parent = t2;
-                return t2;
+                leftmost = &header;
+                header.right = nullptr;
             }
         }
 
+        void count(std::atomic<size_t> shared_counters::*counter) const noexcept {
+            if constexpr (statistics) {
+                if (cmp.counters != nullptr) {
+                    cmp.counters->add(counter);
+                }
+            }
+        }
 
-        explicit Treap(const Compare &cmp) : cmp(cmp) {};
+        static std::uint32_t priority(node_t node) noexcept {
+            return static_cast<node_heavy *>(node)->priority;
+        }
 
-        std::pair<node_t, node_t> split(node_t t, const T &val) {
-            std::pair<node_t, node_t> res;
-            if (t == nullptr) {
-                return res;
+        static size_t size(node_t node) noexcept {
+            if constexpr (order_statistics) {
+                return node == nullptr ? 0 : node->size;
+            } else {
+                return 0;
+            }
+        }
+
+        // Пересчитывает размер поддерева node по детям.
+        static void update(node_t node) noexcept {
+            if constexpr (order_statistics) {
+                node->size = 1 + size(node->left) + size(node->right);
             }
-            if (cmp(t->data, val)) {
-                res = split(t->right, val);
-                t->right = res.first;
-                if (t->right != nullptr) {
-                    t->right->parent = t;
+        }
+
+        void update_path(node_t node) const noexcept {
+            if constexpr (order_statistics) {
+                for (; node != nullptr && node != &header; node = node->parent) {
+                    update(node);
                 }
-                res.first = t;
-                if (res.first != nullptr) {
-                    res.first->parent = nullptr;
+            }
+        }
+
+        // Позиция узла в порядке обхода, вместе с заголовком его дерева.
+        static std::pair<size_t, node_t> position(node_t node) noexcept {
+            size_t pos = size(node->left);
+            while (node->parent->parent != nullptr) {
+                if (node->parent->right == node) {
+                    pos += size(node->parent->left) + 1;
                 }
-                if (res.second != nullptr) {
-                    res.second->parent = nullptr;
+                node = node->parent;
+            }
+            return {pos, node->parent};
+        }
+
+        // k-й по порядку узел поддерева t, nullptr если k >= size(t).
+        static node_t select(node_t t, size_t k) noexcept {
+            while (t != nullptr) {
+                size_t left_size = size(t->left);
+                if (k < left_size) {
+                    t = t->left;
+                } else if (k == left_size) {
+                    return t;
+                } else {
+                    k -= left_size + 1;
+                    t = t->right;
                 }
-                return res;
-            } else {
-                res = split(t->left, val);
-                t->left = res.second;
-                if (t->left != nullptr) {
-                    t->left->parent = t;
+            }
+            return nullptr;
+        }
+
+        // Поиски ниже принимают любой ключ K, сравнимый компаратором с T:
+        // для прозрачных компараторов это не только сам T.
+
+        // Количество элементов, меньших val.
+        template<typename K>
+        size_t rank(const K &val) const {
+            size_t res = 0;
+            node_t cur = root();
+            while (cur != nullptr) {
+                if (cmp(cur->data, val)) {
+                    res += size(cur->left) + 1;
+                    cur = cur->right;
+                } else {
+                    cur = cur->left;
                 }
-                res.second = t;
-                if (res.first != nullptr) {
-                    res.first->parent = nullptr;
+            }
+            return res;
+        }
+
+        Treap(Treap &&other) noexcept: cmp(other.cmp) {
+            take(other);
+        }
+
+        Treap &operator=(Treap const &) = delete;
+
+        // Обмен деревьями и компараторами: ссылки корней и крайних узлов
+        // на заголовок переставляются, поэтому O(1).
+        void swap(Treap &other) noexcept {
+            std::swap(cmp, other.cmp);
+            Treap tmp(std::move(other));
+            other.take(*this);
+            take(tmp);
+        }
+
+        // Все ключи t1 меньше ключей t2. Спуск сверху вниз по правой ветке t1
+        // и левой ветке t2, slot -- куда подвесить следующий узел.
+        node_t merge(node_t t1, node_t t2) noexcept {
+            count(&shared_counters::merges);
+            node_t res = nullptr;
+            node_t parent = nullptr;
+            node_t *slot = &res;
+            while (t1 != nullptr && t2 != nullptr) {
+                if (priority(t1) > priority(t2)) {
+                    *slot = t1;
+                    t1->parent = parent;
+                    parent = t1;
+                    slot = &t1->right;
+                    t1 = t1->right;
+                } else {
+                    *slot = t2;
+                    t2->parent = parent;
+                    parent = t2;
+                    slot = &t2->left;
+                    t2 = t2->left;
                 }
-                if (res.second != nullptr) {
-                    res.second->parent = nullptr;
+            }
+            *slot = t1 != nullptr ? t1 : t2;
+            if (*slot != nullptr) {
+                (*slot)->parent = parent;
+            }
+            update_path(parent);
+            return res;
+        }
+
+
+        explicit Treap(const compare_type &cmp) : cmp(cmp) {};
+
+        // Делит t на ключи меньше val и остальные. Узлы дописываются
+        // в правую ветку левого результата и в левую ветку правого.
+        std::pair<node_t, node_t> split(node_t t, const T &val) {
+            count(&shared_counters::splits);
+            std::pair<node_t, node_t> res;
+            node_t left_tail = nullptr;
+            node_t right_tail = nullptr;
+            while (t != nullptr) {
+                if (cmp(t->data, val)) {
+                    if (left_tail != nullptr) {
+                        left_tail->right = t;
+                    } else {
+                        res.first = t;
+                    }
+                    t->parent = left_tail;
+                    left_tail = t;
+                    t = t->right;
+                } else {
+                    if (right_tail != nullptr) {
+                        right_tail->left = t;
+                    } else {
+                        res.second = t;
+                    }
+                    t->parent = right_tail;
+                    right_tail = t;
+                    t = t->left;
                 }
-                return res;
             }
+            if (left_tail != nullptr) {
+                left_tail->right = nullptr;
+            }
+            if (right_tail != nullptr) {
+                right_tail->left = nullptr;
+            }
+            update_path(left_tail);
+            update_path(right_tail);
+            return res;
         }
 
         void insert(node_t node) {
-            root = insert_wrap(root, node);
+            node_t parent = &header;
+            node_t *slot = &header.left;
+            // Узел станет минимумом, если спуск шел только влево
+            // и после split у него нет левого ребенка; с максимумом так же.
+            bool leftmost_path = true;
+            bool rightmost_path = true;
+            while (*slot != nullptr && priority(*slot) >= priority(node)) {
+                parent = *slot;
+                bool to_right = cmp(parent->data, node->data);
+                leftmost_path &= !to_right;
+                rightmost_path &= to_right;
+                slot = to_right ? &parent->right : &parent->left;
+            }
+            std::tie(node->left, node->right) = split(*slot, node->data);
+            if (node->left != nullptr) {
+                node->left->parent = node;
+            }
+            if (node->right != nullptr) {
+                node->right->parent = node;
+            }
+            node->parent = parent;
+            *slot = node;
+            if (leftmost_path && node->left == nullptr) {
+                leftmost = node;
+            }
+            if (rightmost_path && node->right == nullptr) {
+                header.right = node;
+            }
+            update_path(node);
         }
 
-        node_t insert_wrap(node_t roott, node_t node) {
-            if (roott == nullptr) {
-                return node;
+        // Предшественник node, для end() -- максимум дерева, nullptr, если его нет.
+        node_t predecessor(node_t node) const noexcept {
+            if (node == &header) {
+                return header.right;
+            }
+            if (node->left != nullptr) {
+                return max_node(node->left);
             }
-            if (roott->priority < node->priority) {
-                std::pair<node_t, node_t> res = split(roott, node->data);
-                node->left = res.first;
-                node->right = res.second;
-                if (res.first != nullptr) {
-                    res.first->parent = node;
+            while (node->parent != &header && node->parent->left == node) {
+                node = node->parent;
+            }
+            return node->parent != &header ? node->parent : nullptr;
+        }
+
+        // Подвешивает node листом между prev и hint, соседями по порядку
+        // (hint == end() -- после максимума), и поднимает поворотами,
+        // пока приоритет родителя меньше. Порядок ключей проверяет вызывающий.
+        void insert_before(node_t hint, node_t prev, node_t node) noexcept {
+            node->left = nullptr;
+            node->right = nullptr;
+            // Левая ветка заголовка пуста только у пустого дерева.
+            if (hint->left == nullptr) {
+                hint->left = node;
+                node->parent = hint;
+            } else {
+                prev->right = node;
+                node->parent = prev;
+            }
+            if (prev == nullptr) {
+                leftmost = node;
+            }
+            if (hint == &header) {
+                header.right = node;
+            }
+            while (node->parent != &header && priority(node->parent) < priority(node)) {
+                rotate_up(node);
+            }
+            update_path(node);
+        }
+
+        // Поворот ребра node -- родитель, node встает на место родителя.
+        void rotate_up(node_t node) noexcept {
+            node_t parent = node->parent;
+            node_t grand = parent->parent;
+            if (parent->left == node) {
+                parent->left = node->right;
+                if (node->right != nullptr) {
+                    node->right->parent = parent;
                 }
-                if (res.second != nullptr) {
-                    res.second->parent = node;
+                node->right = parent;
+            } else {
+                parent->right = node->left;
+                if (node->left != nullptr) {
+                    node->left->parent = parent;
                 }
-                return node;
+                node->left = parent;
+            }
+            parent->parent = node;
+            node->parent = grand;
+            if (grand->left == parent) {
+                grand->left = node;
             } else {
-                if (!cmp(roott->data, node->data)) {
-                    roott->left = insert_wrap(roott->left, node);
-                } else {
-                    roott->right = insert_wrap(roott->right, node);
+                grand->right = node;
+            }
+            update(parent);
+        }
+
+        // Строит treap за O(n) по узлам, уже упорядоченным по ключу,
+        // стеком правой ветки декартова дерева.
+        template<typename It>
+        void build(It first, It last) {
+            std::vector<node_t> stack;
+            for (; first != last; ++first) {
+                node_t node = *first;
+                node->right = nullptr;
+                node->parent = nullptr;
+                node_t last_popped = nullptr;
+                while (!stack.empty() && priority(stack.back()) < priority(node)) {
+                    last_popped = stack.back();
+                    update(last_popped);
+                    stack.pop_back();
+                }
+                node->left = last_popped;
+                if (last_popped != nullptr) {
+                    last_popped->parent = node;
+                }
+                if (!stack.empty()) {
+                    stack.back()->right = node;
+                    node->parent = stack.back();
+                }
+                stack.push_back(node);
+            }
+            for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+                update(*it);
+            }
+            set_root(stack.empty() ? nullptr : stack.front());
+        }
+
+        // Объединяет treap'ы с попарно неэквивалентными ключами. Корнем
+        // становится узел с большим приоритетом, второе дерево делится по его
+        // ключу, и половины объединяются с его детьми. Для m узлов в меньшем
+        // дереве это O(m log(n / m + 1)).
+        node_t unite(node_t a, node_t b) {
+            struct task {
+                node_t *slot;
+                node_t parent;
+                node_t a;
+                node_t b;
+            };
+            node_t res = nullptr;
+            std::vector<task> stack{{&res, nullptr, a, b}};
+            std::vector<node_t> touched;
+            while (!stack.empty()) {
+                task cur = stack.back();
+                stack.pop_back();
+                if (cur.a == nullptr || cur.b == nullptr) {
+                    *cur.slot = cur.a != nullptr ? cur.a : cur.b;
+                    if (*cur.slot != nullptr) {
+                        (*cur.slot)->parent = cur.parent;
+                    }
+                    continue;
+                }
+                if (priority(cur.a) < priority(cur.b)) {
+                    std::swap(cur.a, cur.b);
+                }
+                auto [less, greater] = split(cur.b, cur.a->data);
+                *cur.slot = cur.a;
+                cur.a->parent = cur.parent;
+                stack.push_back({&cur.a->left, cur.a, cur.a->left, less});
+                stack.push_back({&cur.a->right, cur.a, cur.a->right, greater});
+                if constexpr (order_statistics) {
+                    touched.push_back(cur.a);
+                }
+            }
+            // Дети попадают в touched позже родителей.
+            for (auto it = touched.rbegin(); it != touched.rend(); ++it) {
+                update(*it);
+            }
+            return res;
+        }
+
+        // Оставляет в t узлы, для которых keep(node) истинно, и возвращает
+        // новый корень. Выброшенные узлы дописываются в dropped, если он не
+        // nullptr. Дети фильтруются раньше родителя, выброшенный узел
+        // заменяется слиянием отфильтрованных детей.
+        template<typename Keep>
+        node_t filter(node_t t, Keep const &keep, std::vector<node_heavy *> *dropped) {
+            std::vector<std::pair<node_t, bool>> stack{{t, false}};
+            std::vector<node_t> results;
+            while (!stack.empty()) {
+                auto [node, children_done] = stack.back();
+                stack.pop_back();
+                if (node == nullptr) {
+                    results.push_back(nullptr);
+                    continue;
                 }
-                if (roott->left != nullptr) {
-                    roott->left->parent = roott;
+                if (!children_done) {
+                    stack.emplace_back(node, true);
+                    stack.emplace_back(node->right, false);
+                    stack.emplace_back(node->left, false);
+                    continue;
                 }
-                if (roott->right != nullptr) {
-                    roott->right->parent = roott;
+                node_t right = results.back();
+                results.pop_back();
+                node_t left = results.back();
+                results.pop_back();
+                if (keep(static_cast<node_heavy *>(node))) {
+                    attach(node, left, right);
+                    results.push_back(node);
+                } else {
+                    if (dropped != nullptr) {
+                        dropped->push_back(static_cast<node_heavy *>(node));
+                    }
+                    results.push_back(merge(left, right));
                 }
-                return roott;
             }
+            if (results.back() != nullptr) {
+                results.back()->parent = nullptr;
+            }
+            return results.back();
+        }
+
+        static void attach(node_t node, node_t left, node_t right) noexcept {
+            node->left = left;
+            node->right = right;
+            if (left != nullptr) {
+                left->parent = node;
+            }
+            if (right != nullptr) {
+                right->parent = node;
+            }
+            update(node);
         }
 
-        void destroy() noexcept {
-            destroy_wrap(root);
+        // Без стека: левый ребенок поворотом поднимается наверх, узел без
+        // левого ребенка удаляется, и обход продолжается с правого.
+        void destroy(node_pool &pool) noexcept {
+            drain(root(), [&pool](node_t node) noexcept {
+                pool.destroy(static_cast<node_heavy *>(node));
+            });
+            set_root(nullptr);
         }
 
-        void destroy_wrap(node_t n) noexcept {
-            if (n != nullptr) {
-                destroy_wrap(n->left);
-                destroy_wrap(n->right);
-                delete static_cast<node_heavy *>(n);
+        // Разбирает поддерево t тем же обходом без стека и отдает каждый
+        // узел f. Связи узла на этой стороне к моменту вызова f уже
+        // прочитаны, f может его освободить.
+        template<typename F>
+        static void drain(node_t t, F &&f) noexcept {
+            node_t cur = t;
+            while (cur != nullptr) {
+                if (cur->left != nullptr) {
+                    node_t left = cur->left;
+                    cur->left = left->right;
+                    left->right = cur;
+                    cur = left;
+                } else {
+                    node_t right = cur->right;
+                    f(cur);
+                    cur = right;
+                }
             }
         }
 
-        void erase(T val) {
-            node_t prev = nullptr;
-            node_t *roott = &(root);
-            node_t cur = *roott;
-            while (!(cur->data == val)) {
-                if (!cmp(val, cur->data) && cur->right != nullptr) {
-                    prev = cur;
+        // Вырезает node по родительским ссылкам: слитые дети встают
+        // на его место, спуска от корня нет.
+        void unlink(node_t node) noexcept {
+            node_t parent = node->parent;
+            if (node == leftmost) {
+                leftmost = node->right != nullptr ? min_node(node->right) : parent;
+            }
+            if (node == header.right) {
+                header.right = node->left != nullptr ? max_node(node->left) : parent != &header ? parent : nullptr;
+            }
+            node_t merged = merge(node->left, node->right);
+            if (merged != nullptr) {
+                merged->parent = parent;
+            }
+            if (parent->left == node) {
+                parent->left = merged;
+            } else {
+                parent->right = merged;
+            }
+            update_path(parent);
+        }
+
+        // Спуск от корня: первый элемент не меньше val.
+        template<typename K>
+        node_t lower_bound(const K &val) const {
+            node_t res = nullptr;
+            node_t cur = root();
+            while (cur != nullptr) {
+                if (cmp(cur->data, val)) {
                     cur = cur->right;
-                } else if (cmp(val, cur->data) && cur->left != nullptr) {
-                    prev = cur;
+                } else {
+                    res = cur;
                     cur = cur->left;
                 }
             }
-            if (prev == nullptr) {
-                *roott = merge((*roott)->left, (*roott)->right);
-                if (*roott != nullptr) {
-                    (*roott)->parent = nullptr;
+            return res;
+        }
+
+        // Спуск от корня: первый элемент строго больше val.
+        template<typename K>
+        node_t upper_bound(const K &val) const {
+            node_t res = nullptr;
+            node_t cur = root();
+            while (cur != nullptr) {
+                if (cmp(val, cur->data)) {
+                    res = cur;
+                    cur = cur->left;
+                } else {
+                    cur = cur->right;
                 }
-                return;
             }
-            if (cur == prev->right) {
-                prev->right = merge(cur->left, cur->right);
-                if (prev->right != nullptr) {
-                    prev->right->parent = prev;
+            return res;
+        }
+
+        // Узел с ключом, эквивалентным val. Спуск как в lower_bound, по одному
+        // сравнению на уровень, затем одна проверка кандидата. Для чисел
+        // спуск с двумя сравнениями и выходом на найденном узле быстрее:
+        // по BM_treap_find_key на 10^3..10^4 ключей на 20-25%, дальше -- в пределах шума.
+        template<typename K>
+        node_t exists(const K &val) const {
+            if constexpr (std::is_arithmetic_v<T> && std::is_same_v<K, T>) {
+                node_t t = root();
+                while (t != nullptr) {
+                    bool less = cmp(val, t->data);
+                    bool greater = cmp(t->data, val);
+                    if (less == greater) {
+                        break;
+                    }
+                    t = less ? t->left : t->right;
                 }
-                return;
+                return t;
+            }
+            node_t res = nullptr;
+            node_t cur = root();
+            while (cur != nullptr) {
+                bool to_right = cmp(cur->data, val);
+                res = to_right ? res : cur;
+                cur = to_right ? cur->right : cur->left;
+            }
+            return res != nullptr && !cmp(val, res->data) ? res : nullptr;
+        }
+
+    private:
+        // Забирает дерево other, other становится пустым.
+        void take(Treap &other) noexcept {
+            header.left = std::exchange(other.header.left, nullptr);
+            header.right = std::exchange(other.header.right, nullptr);
+            leftmost = other.leftmost == &other.header ? &header : other.leftmost;
+            other.leftmost = &other.header;
+            if (header.left != nullptr) {
+                header.left->parent = &header;
+            }
+        }
+    };
+
+private:
+    Treap<Left, tag_key, CompareLeft> left_tree;
+    Treap<Right, tag_value, CompareRight> right_tree;
+    size_t pair_count = 0;
+    node_pool pool;
+    priority_generator next_priority{reinterpret_cast<std::uintptr_t>(this)};
+public:
+    template<typename side>
+    struct iterator {
+
+        using type = typename std::conditional<std::is_same_v<side, tag_key>, left_t, right_t>::type;
+        using inv_side = typename std::conditional<std::is_same_v<side, tag_key>, tag_value, tag_key>::type;
+        using compare_t = typename std::conditional<std::is_same_v<side, tag_key>, CompareLeft, CompareRight>::type;
+        using treap_t = Treap<type, side, compare_t>;
+
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = type const *;
+        using reference = type const &;
+
+        // Узел или заголовок дерева для end(): у заголовка нет родителя.
+        node_light<type, side> *cur_node;
+
+        explicit iterator(node_light<type, side> *nodeLight) noexcept: cur_node(nodeLight) {};
+
+        explicit iterator(node_heavy *nodeHeavy) noexcept: cur_node(
+                static_cast<node_light<type, side> *>(nodeHeavy)) {};
+
+        type const &operator*() const noexcept {
+            return cur_node->data;
+        };
+
+        iterator &operator++() noexcept {
+            cur_node = cur_node->next();
+            return *this;
+        };
+
+        iterator operator++(int) noexcept {
+            iterator prev = *this;
+            ++*this;
+            return prev;
+        };
+
+        // Из end() -- сразу в максимум, он хранится в заголовке.
+        iterator &operator--() noexcept {
+            cur_node = is_end() ? cur_node->right : cur_node->prev();
+            return *this;
+        };
+
+        iterator operator--(int) {
+            iterator prev = *this;
+            --*this;
+            return prev;
+        };
+
+        friend bool operator==(iterator first, iterator second) noexcept {
+            return first.cur_node == second.cur_node;
+        }
+
+        friend bool operator!=(iterator first, iterator second) noexcept {
+            return first.cur_node != second.cur_node;
+        }
+
+        // Для end() не определен.
+        iterator<inv_side> flip() const noexcept {
+            return iterator<inv_side>(static_cast<node_heavy *>(cur_node));
+        }
+
+        // С order_statistics работают за O(log n), иначе за O(n).
+        // Находятся через ADL: using std::distance; distance(first, last);
+        friend difference_type distance(iterator first, iterator last) noexcept {
+            if constexpr (order_statistics) {
+                return static_cast<difference_type>(last.index()) - static_cast<difference_type>(first.index());
+            } else {
+                difference_type res = 0;
+                for (; first != last; ++first) {
+                    res++;
+                }
+                return res;
+            }
+        }
+
+        friend void advance(iterator &it, difference_type n) noexcept {
+            if constexpr (order_statistics) {
+                auto head = it.is_end() ? it.cur_node : treap_t::position(it.cur_node).second;
+                auto node = treap_t::select(head->left, it.index() + n);
+                it.cur_node = node != nullptr ? node : head;
+            } else {
+                for (; n > 0; n--) {
+                    ++it;
+                }
+                for (; n < 0; n++) {
+                    --it;
+                }
+            }
+        }
+
+    private:
+        bool is_end() const noexcept {
+            return cur_node->parent == nullptr;
+        }
+
+        size_t index() const noexcept {
+            if (is_end()) {
+                return treap_t::size(cur_node->left);
+            }
+            return treap_t::position(cur_node).first;
+        }
+
+    };
+
+    using left_iterator = iterator<tag_key>;
+    using right_iterator = iterator<tag_value>;
+
+    // Пара, вынутая extract_left/extract_right вместе со своим узлом.
+    // Узел остается в слоте пула исходного bimap и помечен вынутым, handle
+    // держит anchor пула. Исходный bimap можно менять и разрушать: слэб
+    // со слотом живет, пока жив handle.
+    struct node_type {
+        node_type() noexcept = default;
+
+        node_type(node_type &&other) noexcept
+                : node(std::exchange(other.node, nullptr)), home(std::exchange(other.home, nullptr)) {}
+
+        node_type &operator=(node_type &&other) noexcept {
+            if (this != &other) {
+                reset();
+                node = std::exchange(other.node, nullptr);
+                home = std::exchange(other.home, nullptr);
+            }
+            return *this;
+        }
+
+        ~node_type() {
+            reset();
+        }
+
+        bool empty() const noexcept {
+            return node == nullptr;
+        }
+
+        explicit operator bool() const noexcept {
+            return node != nullptr;
+        }
+
+        // Ключи можно менять: узел не связан ни с одним деревом.
+        left_t &left() const noexcept {
+            return node->node_light<Left, tag_key>::data;
+        }
+
+        right_t &right() const noexcept {
+            return node->node_light<Right, tag_value>::data;
+        }
+
+    private:
+        friend struct bimap;
+
+        using anchor = typename node_pool::anchor;
+
+        node_type(node_heavy *node, anchor *home) noexcept: node(node), home(home) {}
+
+        void reset() noexcept {
+            if (node != nullptr) {
+                node_pool::release_detached(std::exchange(home, nullptr), std::exchange(node, nullptr));
+            }
+        }
+
+        node_heavy *node = nullptr;
+        anchor *home = nullptr;
+    };
+
+    // Результат insert(node_type &&): при конфликте ключей пара остается в node.
+    struct insert_return_type {
+        left_iterator position;
+        bool inserted;
+        node_type node;
+    };
+
+    using allocator_type = Allocator;
+
+    // Создает bimap не содержащий ни одной пары.
+    explicit bimap(CompareLeft compare_left = CompareLeft(),
+          CompareRight compare_right = CompareRight(), const Allocator &alloc = Allocator())
+            : left_tree(compare_left), right_tree(compare_right), pool(slot_allocator(alloc)) {
+        bind_stats();
+    };
+
+    explicit bimap(const Allocator &alloc) : bimap(CompareLeft(), CompareRight(), alloc) {};
+
+    //bimap() = default;
+
+    // Конструкторы от других и присваивания
+    bimap(bimap const &other) : left_tree(other.left_tree.cmp), right_tree(other.right_tree.cmp),
+                                pool(slot_traits::select_on_container_copy_construction(other.pool.get_allocator())) {
+        bind_stats();
+        clone_from(other);
+    };
+
+    // Строит bimap по диапазону пар (left, right), отсортированному по left.
+    // Неотсортированный вход тоже принимается, но строится за O(n log n).
+    // Из пар с одинаковым left остается первая, затем из оставшихся
+    // пар с одинаковым right тоже остается первая.
+    template<typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+    bimap(InputIt first, InputIt last, CompareLeft compare_left = CompareLeft(),
+          CompareRight compare_right = CompareRight(), const Allocator &alloc = Allocator())
+            : left_tree(compare_left), right_tree(compare_right), pool(slot_allocator(alloc)) {
+        bind_stats();
+        build_sorted(first, last);
+    }
+
+    bimap(bimap &&other) noexcept: left_tree(std::move(other.left_tree)), right_tree(std::move(other.right_tree)),
+                                   pair_count(std::exchange(other.pair_count, 0)), pool(std::move(other.pool)) {
+        bind_stats();
+    };
+
+    // Освободившиеся узлы остаются в пуле и идут под копию.
+    bimap &operator=(bimap const &other) {
+        if (this == &other) {
+            return *this;
+        }
+        clear();
+        if constexpr (slot_traits::propagate_on_container_copy_assignment::value) {
+            if (pool.get_allocator() != other.pool.get_allocator()) {
+                pool.release_all();
+            }
+            pool.get_allocator() = other.pool.get_allocator();
+        }
+        left_tree.cmp = other.left_tree.cmp;
+        right_tree.cmp = other.right_tree.cmp;
+        bind_stats();
+        clone_from(other);
+        return *this;
+    }
+
+    // Обмен содержимым за O(1): прежние пары удалит деструктор other.
+    bimap &operator=(bimap &&other) {
+        if (this == &other) {
+            return *this;
+        }
+        if constexpr (!slot_traits::propagate_on_container_move_assignment::value &&
+                      !slot_traits::is_always_equal::value) {
+            if (pool.get_allocator() != other.pool.get_allocator()) {
+                // Узлы other нельзя забрать себе: они живут в чужом пуле.
+                return *this = static_cast<bimap const &>(other);
+            }
+        }
+        if constexpr (slot_traits::propagate_on_container_move_assignment::value) {
+            std::swap(pool.get_allocator(), other.pool.get_allocator());
+        }
+        pool.swap_slabs(other.pool);
+        std::swap(this->pair_count, other.pair_count);
+        left_tree.swap(other.left_tree);
+        right_tree.swap(other.right_tree);
+        bind_stats();
+        other.bind_stats();
+        return *this;
+    };
+
+    // Деструктор. Вызывается при удалении объектов bimap.
+    // Инвалидирует все итераторы ссылающиеся на элементы этого bimap
+    // (включая итераторы ссылающиеся на элементы следующие за последними).
+    ~bimap() {
+        left_tree.destroy(pool);
+    };
+
+    // Задает seed генератора приоритетов: одинаковые seed и последовательность
+    // операций дают одинаковую форму деревьев.
+    void seed(std::uint64_t value) noexcept {
+        next_priority = priority_generator(value);
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_type(pool.get_allocator());
+    }
+
+    // Резервирует место под n пар: вставки до этого размера не обращаются к аллокатору.
+    void reserve(size_t n) {
+        if (n > pair_count) {
+            pool.reserve(n - pair_count);
+        }
+    }
+    // Заменяет содержимое bimap парами из диапазона, см. конструктор от диапазона.
+    template<typename InputIt>
+    void assign_sorted(InputIt first, InputIt last) {
+        clear();
+        build_sorted(first, last);
+    }
+
+    // Удаляет все пары за один обход дерева. Память узлов остается
+    // в пуле и переиспользуется следующими вставками.
+    void clear() noexcept {
+        left_tree.destroy(pool);
+        right_tree.set_root(nullptr);
+        pair_count = 0;
+    }
+
+    // Статистика, доступна с политикой statistics: счетчики с последнего
+    // reset_stats() и форма обоих деревьев, которая считается обходом за O(n).
+    template<typename P = Policy, typename = std::enable_if_t<P::statistics>>
+    bimap_stats stats() const {
+        bimap_stats res;
+        static_cast<bimap_counters &>(res) = pool.counters.load();
+        res.left = tree_stats(left_tree);
+        res.right = tree_stats(right_tree);
+        return res;
+    }
+
+    template<typename P = Policy, typename = std::enable_if_t<P::statistics>>
+    void reset_stats() noexcept {
+        pool.counters.reset();
+    }
+
+private:
+    void bind_stats() noexcept {
+        if constexpr (statistics) {
+            left_tree.cmp.counters = &pool.counters;
+            right_tree.cmp.counters = &pool.counters;
+        }
+    }
+
+    void count_operation() const noexcept {
+        if constexpr (statistics) {
+            pool.counters.add(&shared_counters::operations);
+        }
+    }
+
+    // Обход со стеком, а не рекурсией: глубина treap'а не ограничена.
+    template<typename T, typename side, typename cmp>
+    static bimap_tree_stats tree_stats(Treap<T, side, cmp> const &t) {
+        bimap_tree_stats res;
+        size_t nodes = 0;
+        size_t depth_sum = 0;
+        std::vector<std::pair<node_light<T, side> const *, size_t>> stack;
+        if (t.root() != nullptr) {
+            stack.emplace_back(t.root(), 0);
+        }
+        while (!stack.empty()) {
+            auto [node, depth] = stack.back();
+            stack.pop_back();
+            if (depth == res.depth_histogram.size()) {
+                res.depth_histogram.push_back(0);
+            }
+            res.depth_histogram[depth]++;
+            nodes++;
+            depth_sum += depth;
+            for (auto child : {node->left, node->right}) {
+                if (child != nullptr) {
+                    stack.emplace_back(child, depth + 1);
+                }
+            }
+        }
+        if (nodes != 0) {
+            res.max_depth = res.depth_histogram.size() - 1;
+            res.average_depth = static_cast<double>(depth_sum) / static_cast<double>(nodes);
+        }
+        return res;
+    }
+
+private:
+    // Открытая адресация по адресу узла. При копировании переводит узлы
+    // other в их копии, в bimap_union -- узлы в позиции в обходе.
+    template<typename Value>
+    struct node_table {
+        std::vector<std::pair<const node_heavy *, Value>> slots;
+        size_t shift = 60;
+
+        explicit node_table(size_t n) {
+            size_t capacity = 16;
+            while (capacity < 2 * n) {
+                capacity *= 2;
+                shift--;
+            }
+            slots.resize(capacity);
+        }
+
+        size_t home(const node_heavy *node) const noexcept {
+            auto key = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(node));
+            return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> shift);
+        }
+
+        void insert(const node_heavy *from, Value to) noexcept {
+            size_t i = home(from);
+            while (slots[i].first != nullptr) {
+                i = (i + 1) & (slots.size() - 1);
+            }
+            slots[i] = {from, to};
+        }
+
+        Value const &at(const node_heavy *key) const noexcept {
+            size_t i = home(key);
+            while (slots[i].first != key) {
+                i = (i + 1) & (slots.size() - 1);
+            }
+            return slots[i].second;
+        }
+
+        template<typename T, typename side>
+        node_light<T, side> *find(node_light<T, side> *from) const noexcept {
+            if (from == nullptr) {
+                return nullptr;
+            }
+            return at(static_cast<const node_heavy *>(from));
+        }
+    };
+
+    using clone_table = node_table<node_heavy *>;
+
+    using left_node = node_light<Left, tag_key>;
+    using right_node = node_light<Right, tag_value>;
+
+    // Копирует оба дерева other вместе с формой и приоритетами за O(n)
+    // в узлы нашего пула и возвращает корни копий. Левое дерево копируется
+    // обходом в глубину, связи правого переносятся через таблицу
+    // соответствия узлов.
+    std::pair<left_node *, right_node *> clone_trees(bimap const &other) {
+        clone_table table(other.pair_count);
+        pool.reserve(other.pair_count);
+
+        std::pair<left_node *, right_node *> res;
+        // Узел other, родитель его копии и место, куда ее подвесить.
+        std::vector<std::tuple<left_node *, left_node *, left_node **>> stack;
+        stack.emplace_back(other.left_tree.root(), nullptr, &res.first);
+        try {
+            while (!stack.empty()) {
+                auto [from, parent, slot] = stack.back();
+                stack.pop_back();
+                if (from == nullptr) {
+                    continue;
+                }
+                auto from_heavy = static_cast<node_heavy *>(from);
+                left_node *to = pool.create(from_heavy->priority, from->data,
+                                            static_cast<right_node *>(from_heavy)->data);
+                to->parent = parent;
+                *slot = to;
+                if constexpr (order_statistics) {
+                    to->size = from->size;
+                }
+                table.insert(from_heavy, static_cast<node_heavy *>(to));
+                stack.emplace_back(from->right, to, &to->right);
+                stack.emplace_back(from->left, to, &to->left);
+            }
+        } catch (...) {
+            Treap<Left, tag_key, CompareLeft> partial(left_tree.cmp);
+            partial.set_root(res.first);
+            partial.destroy(pool);
+            throw;
+        }
+
+        for (auto const &slot : table.slots) {
+            if (slot.first == nullptr) {
+                continue;
+            }
+            const right_node *from = slot.first;
+            right_node *to = slot.second;
+            to->left = table.find(from->left);
+            to->right = table.find(from->right);
+            if (to->left != nullptr) {
+                to->left->parent = to;
+            }
+            if (to->right != nullptr) {
+                to->right->parent = to;
+            }
+            if constexpr (order_statistics) {
+                to->size = from->size;
+            }
+        }
+        res.second = table.find(other.right_tree.root());
+        if (res.second != nullptr) {
+            res.second->parent = nullptr;
+        }
+        return res;
+    }
+
+    // bimap пуст.
+    void clone_from(bimap const &other) {
+        auto [left_root, right_root] = clone_trees(other);
+        left_tree.set_root(left_root);
+        right_tree.set_root(right_root);
+        pair_count = other.pair_count;
+    }
+
+    template<typename InputIt>
+    void build_sorted(InputIt first, InputIt last) {
+        std::vector<node_heavy *> nodes;
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                typename std::iterator_traits<InputIt>::iterator_category>) {
+            auto n = static_cast<size_t>(std::distance(first, last));
+            nodes.reserve(n);
+            pool.reserve(n);
+        }
+        auto less_left = [this](node_heavy *a, node_heavy *b) {
+            return left_tree.cmp(a->node_light<Left, tag_key>::data, b->node_light<Left, tag_key>::data);
+        };
+        bool sorted = true;
+        try {
+            for (; first != last; ++first) {
+                auto &&p = *first;
+                if (sorted && !nodes.empty()) {
+                    auto const &prev = nodes.back()->node_light<Left, tag_key>::data;
+                    if (left_tree.cmp(p.first, prev)) {
+                        sorted = false;
+                    } else if (!left_tree.cmp(prev, p.first)) {
+                        continue;
+                    }
+                }
+                nodes.push_back(pool.create(next_priority(), std::forward<decltype(p)>(p).first,
+                                            std::forward<decltype(p)>(p).second));
+            }
+        } catch (...) {
+            for (auto node : nodes) {
+                pool.destroy(node);
+            }
+            throw;
+        }
+
+        std::vector<char> dropped(nodes.size(), false);
+        if (!sorted) {
+            std::stable_sort(nodes.begin(), nodes.end(), less_left);
+            for (size_t i = 1; i < nodes.size(); i++) {
+                dropped[i] = !less_left(nodes[i - 1], nodes[i]);
+            }
+        }
+        auto by_right = sorted_indices(nodes, right_tree);
+        drop_equal(right_tree, nodes, by_right, dropped);
+
+        std::vector<node_heavy *> right_order;
+        right_order.reserve(nodes.size());
+        for (auto i : by_right) {
+            if (!dropped[i]) {
+                right_order.push_back(nodes[i]);
+            }
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (dropped[i]) {
+                pool.destroy(nodes[i]);
+            } else {
+                nodes[kept++] = nodes[i];
+            }
+        }
+        nodes.resize(kept);
+
+        left_tree.build(nodes.begin(), nodes.end());
+        right_tree.build(right_order.begin(), right_order.end());
+        pair_count = kept;
+    }
+
+    // Отмечает в dropped узлы, чьи ключи уже есть в t. order -- индексы nodes,
+    // упорядоченные по ключу стороны t. Поддерево и отрезок order делятся
+    // ключом корня поддерева, как в unite.
+    template<typename T, typename side, typename cmp>
+    static void drop_existing(const Treap<T, side, cmp> &t, std::vector<node_heavy *> const &nodes,
+                              std::vector<size_t> const &order, std::vector<char> &dropped) {
+        auto key = [&](size_t i) -> T const & {
+            return static_cast<node_light<T, side> *>(nodes[i])->data;
+        };
+        std::vector<std::tuple<node_light<T, side> *, size_t, size_t>> stack{{t.root(), 0, order.size()}};
+        while (!stack.empty()) {
+            auto [node, lo, hi] = stack.back();
+            stack.pop_back();
+            if (node == nullptr || lo == hi) {
+                continue;
+            }
+            size_t mid = static_cast<size_t>(std::partition_point(order.begin() + lo, order.begin() + hi, [&](size_t i) {
+                return t.cmp(key(i), node->data);
+            }) - order.begin());
+            size_t next = mid;
+            while (next < hi && !t.cmp(node->data, key(order[next]))) {
+                dropped[order[next++]] = true;
+            }
+            stack.emplace_back(node->left, lo, mid);
+            stack.emplace_back(node->right, next, hi);
+        }
+    }
+
+    // Из не отброшенных ранее пар с эквивалентными ключами стороны t
+    // оставляет первую по order.
+    template<typename T, typename side, typename cmp>
+    static void drop_equal(const Treap<T, side, cmp> &t, std::vector<node_heavy *> const &nodes,
+                           std::vector<size_t> const &order, std::vector<char> &dropped) {
+        size_t prev = nodes.size();
+        for (auto i : order) {
+            if (dropped[i]) {
+                continue;
+            }
+            if (prev != nodes.size() &&
+                !t.cmp(nodes[prev]->node_light<T, side>::data, nodes[i]->node_light<T, side>::data)) {
+                dropped[i] = true;
+            } else {
+                prev = i;
+            }
+        }
+    }
+
+    template<typename side, typename type, typename cmp>
+    std::vector<size_t> sorted_indices(std::vector<node_heavy *> const &nodes,
+                                       const Treap<type, side, cmp> &t) const {
+        std::vector<size_t> order(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return t.cmp(nodes[a]->node_light<type, side>::data, nodes[b]->node_light<type, side>::data);
+        });
+        return order;
+    }
+
+    // Сколько уровней рекурсии unite и filter делить между потоками:
+    // около одного листа рекурсии на ядро. Маленькие деревья не делятся.
+    static constexpr size_t parallel_cutoff = 1 << 14;
+
+    static int fork_depth(size_t n) {
+        if (n < parallel_cutoff) {
+            return 0;
+        }
+        unsigned threads = std::thread::hardware_concurrency();
+        if (threads == 0) {
+            threads = 2;
+        }
+        int depth = 0;
+        while ((1u << depth) < threads) {
+            depth++;
+        }
+        return depth;
+    }
+
+    // Левое поддерево обрабатывается в отдельном потоке, правое -- в текущем.
+    // Поддеревья не пересекаются, поэтому потоки пишут в разные узлы.
+    template<typename T, typename side, typename cmp>
+    static node_light<T, side> *parallel_unite(Treap<T, side, cmp> &t, node_light<T, side> *a,
+                                               node_light<T, side> *b, int depth) {
+        if (depth == 0 || a == nullptr || b == nullptr) {
+            return t.unite(a, b);
+        }
+        if (Treap<T, side, cmp>::priority(a) < Treap<T, side, cmp>::priority(b)) {
+            std::swap(a, b);
+        }
+        auto [less, greater] = t.split(b, a->data);
+        auto left = std::async(std::launch::async, [&t, a, less = less, depth] {
+            return parallel_unite(t, a->left, less, depth - 1);
+        });
+        auto right = parallel_unite(t, a->right, greater, depth - 1);
+        Treap<T, side, cmp>::attach(a, left.get(), right);
+        a->parent = nullptr;
+        return a;
+    }
+
+    template<typename T, typename side, typename cmp, typename Keep>
+    static node_light<T, side> *parallel_filter(Treap<T, side, cmp> &t, node_light<T, side> *node, Keep const &keep,
+                                                std::vector<node_heavy *> *dropped, int depth) {
+        if (depth == 0 || node == nullptr) {
+            return t.filter(node, keep, dropped);
+        }
+        std::vector<node_heavy *> dropped_left;
+        auto left = std::async(std::launch::async, [&, depth] {
+            return parallel_filter(t, node->left, keep, dropped != nullptr ? &dropped_left : nullptr, depth - 1);
+        });
+        auto right = parallel_filter(t, node->right, keep, dropped, depth - 1);
+        auto left_root = left.get();
+        if (dropped != nullptr) {
+            dropped->insert(dropped->end(), dropped_left.begin(), dropped_left.end());
+        }
+        node_light<T, side> *res;
+        if (keep(static_cast<node_heavy *>(node))) {
+            Treap<T, side, cmp>::attach(node, left_root, right);
+            res = node;
+        } else {
+            if (dropped != nullptr) {
+                dropped->push_back(static_cast<node_heavy *>(node));
             }
-            prev->left = merge(cur->left, cur->right);
-            if (prev->left != nullptr)
-                prev->left->parent = prev;
+            res = t.merge(left_root, right);
         }
-
-        node_t exists(const T &val) const {
-            return exists_wrap(root, val);
+        if (res != nullptr) {
+            res->parent = nullptr;
         }
+        return res;
+    }
 
+    // Фильтрует пары деревьев left и right одним предикатом. keep
+    // вызывается один раз на пару, при обходе левого дерева; правое дерево
+    // затем чистится по отсортированному списку выброшенных узлов.
+    // Возвращает выброшенные узлы, они уже не связаны ни с одним деревом.
+    template<typename Keep>
+    static std::vector<node_heavy *> filter_pairs(Treap<Left, tag_key, CompareLeft> &left,
+                                                  Treap<Right, tag_value, CompareRight> &right,
+                                                  Keep const &keep, size_t n) {
+        std::vector<node_heavy *> dropped;
+        int depth = fork_depth(n);
+        left.set_root(parallel_filter(left, left.root(), keep, &dropped, depth));
+        if (dropped.empty()) {
+            return dropped;
+        }
+        std::vector<node_heavy const *> sorted(dropped.begin(), dropped.end());
+        std::sort(sorted.begin(), sorted.end(), std::less<>());
+        right.set_root(parallel_filter(right, right.root(), [&sorted](node_heavy const *node) {
+            return !std::binary_search(sorted.begin(), sorted.end(), node, std::less<>());
+        }, nullptr, depth));
+        return dropped;
+    }
 
-        node_t exists_wrap(node_t t, const T &val) const {
-            if (t == nullptr || t->data == val) {
-                return t;
-            }
-            if (cmp(val, t->data)) {
-                return exists_wrap(t->left, val);
+    // Узлы дерева в порядке обхода.
+    template<typename T, typename side, typename cmp>
+    static std::vector<node_heavy *> in_order(Treap<T, side, cmp> const &t) {
+        std::vector<node_heavy *> res;
+        std::vector<node_light<T, side> *> stack;
+        node_light<T, side> *node = t.root();
+        while (node != nullptr || !stack.empty()) {
+            if (node != nullptr) {
+                stack.push_back(node);
+                node = node->left;
             } else {
-                return exists_wrap(t->right, val);
+                node = stack.back();
+                stack.pop_back();
+                res.push_back(static_cast<node_heavy *>(node));
+                node = node->right;
             }
         }
-    };
-
-private:
-    Treap<Left, tag_key, CompareLeft> left_tree;
-    Treap<Right, tag_value, CompareRight> right_tree;
-    size_t pair_count = 0;
-public:
-    template<typename side>
-    struct iterator {
+        return res;
+    }
 
-        using type = typename std::conditional<std::is_same_v<side, tag_key>, left_t, right_t>::type;
-        using inv_side = typename std::conditional<std::is_same_v<side, tag_key>, tag_value, tag_key>::type;
+    // Индексы в nodes узлов из order, order -- перестановка nodes.
+    static std::vector<size_t> positions(std::vector<node_heavy *> const &nodes,
+                                         std::vector<node_heavy *> const &order) {
+        node_table<size_t> index(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            index.insert(nodes[i], i);
+        }
+        std::vector<size_t> res;
+        res.reserve(order.size());
+        for (auto node : order) {
+            res.push_back(index.at(node));
+        }
+        return res;
+    }
 
-        node_light<type, side> *cur_node;
+    template<typename Keep>
+    void keep_if(Keep const &keep) {
+        auto dropped = filter_pairs(left_tree, right_tree, keep, pair_count);
+        for (auto node : dropped) {
+            pool.destroy(node);
+        }
+        pair_count -= dropped.size();
+    }
 
-        node_heavy* tree_root;
+    // Есть ли в bimap пара, эквивалентная паре узла.
+    bool contains_pair(node_heavy const *node) const {
+        auto found = left_tree.exists(node->node_light<Left, tag_key>::data);
+        if (found == nullptr) {
+            return false;
+        }
+        auto const &right = node->node_light<Right, tag_value>::data;
+        auto const &found_right = static_cast<node_heavy const *>(found)->node_light<Right, tag_value>::data;
+        return !right_tree.cmp(right, found_right) && !right_tree.cmp(found_right, right);
+    }
 
-        explicit iterator(node_light<type, side> *nodeLight, node_heavy* root) noexcept: cur_node(nodeLight), tree_root(root) {};
+public:
+    // Операции над множествами пар. Сравниваются пары целиком: пары с
+    // одинаковым left и разными right различны. Результат получает
+    // компараторы и аллокатор a. Обход деревьев делится между потоками
+    // на верхних уровнях рекурсии для bimap от parallel_cutoff пар.
+
+    // Пары a и те пары b, чьи left и right не встречаются в a.
+    friend bimap bimap_union(bimap const &a, bimap const &b) {
+        bimap res(a);
+        // Обходы b уже упорядочены, поэтому ключи b сверяются с a
+        // так же, как в insert_batch, без поиска каждого ключа.
+        auto nodes = in_order(b.left_tree);
+        std::vector<size_t> by_left(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            by_left[i] = i;
+        }
+        std::vector<size_t> by_right = positions(nodes, in_order(b.right_tree));
+        int depth = fork_depth(a.size() + b.size());
+        std::vector<char> left_taken(nodes.size(), false);
+        std::vector<char> right_taken(nodes.size(), false);
+        auto right_checked = std::async(depth == 0 ? std::launch::deferred : std::launch::async, [&] {
+            drop_existing(a.right_tree, nodes, by_right, right_taken);
+        });
+        drop_existing(a.left_tree, nodes, by_left, left_taken);
+        right_checked.get();
+
+        std::vector<node_heavy *> copies(nodes.size(), nullptr);
+        std::vector<node_heavy *> left_order;
+        try {
+            for (size_t i = 0; i < nodes.size(); i++) {
+                if (!left_taken[i] && !right_taken[i]) {
+                    copies[i] = res.pool.create(res.next_priority(), nodes[i]->node_light<Left, tag_key>::data,
+                                                nodes[i]->node_light<Right, tag_value>::data);
+                    left_order.push_back(copies[i]);
+                }
+            }
+        } catch (...) {
+            for (auto node : left_order) {
+                res.pool.destroy(node);
+            }
+            throw;
+        }
+        std::vector<node_heavy *> right_order;
+        right_order.reserve(left_order.size());
+        for (auto i : by_right) {
+            if (copies[i] != nullptr) {
+                right_order.push_back(copies[i]);
+            }
+        }
 
-        explicit iterator(node_heavy *nodeHeavy, node_heavy* root) noexcept: cur_node(
-                static_cast<node_light<type, side> *>(nodeHeavy)), tree_root(root) {};
+        Treap<Left, tag_key, CompareLeft> extra_left(res.left_tree.cmp);
+        Treap<Right, tag_value, CompareRight> extra_right(res.right_tree.cmp);
+        extra_left.build(left_order.begin(), left_order.end());
+        extra_right.build(right_order.begin(), right_order.end());
+        auto right_done = std::async(depth == 0 ? std::launch::deferred : std::launch::async, [&] {
+            res.right_tree.set_root(parallel_unite(res.right_tree, res.right_tree.root(), extra_right.root(), depth));
+        });
+        res.left_tree.set_root(parallel_unite(res.left_tree, res.left_tree.root(), extra_left.root(), depth));
+        right_done.get();
+        res.pair_count += left_order.size();
+        return res;
+    }
 
-        explicit iterator(nullptr_t, node_heavy* root) noexcept : cur_node(nullptr), tree_root(root) {};
+    // Пары, которые есть и в a, и в b.
+    friend bimap bimap_intersection(bimap const &a, bimap const &b) {
+        bimap res(a);
+        res.keep_if([&b](node_heavy const *node) { return b.contains_pair(node); });
+        return res;
+    }
 
-        type const &operator*() const noexcept {
-            return cur_node->data;
-        };
+    // Пары a, которых нет в b.
+    friend bimap bimap_difference(bimap const &a, bimap const &b) {
+        bimap res(a);
+        res.keep_if([&b](node_heavy const *node) { return !b.contains_pair(node); });
+        return res;
+    }
 
-        iterator &operator++() noexcept {
-            cur_node = cur_node->next();
+private:
+    struct discard_output {
+        discard_output &operator*() noexcept {
             return *this;
-        };
-
-        iterator operator++(int) noexcept {
-            iterator prev = *this;
-            ++*this;
-            return prev;
-        };
+        }
 
-        iterator &operator--() noexcept {
-            if (cur_node == nullptr){
-                auto cur = static_cast<node_light<type, side>*>(tree_root);
-                while (cur->right != nullptr){
-                    cur = cur->right;
-                }
-                cur_node = cur;
-                return *this;
-            }
-            cur_node = cur_node->prev();
+        discard_output &operator++() noexcept {
             return *this;
-        };
-
-        iterator operator--(int) {
-            iterator prev = *this;
-            --*this;
-            return prev;
-        };
-
-        friend bool operator==(iterator first, iterator second) noexcept {
-            return first.cur_node == second.cur_node;
         }
 
-        friend bool operator!=(iterator first, iterator second) noexcept {
-            return first.cur_node != second.cur_node;
+        discard_output operator++(int) noexcept {
+            return *this;
         }
 
-        iterator<inv_side> flip() const noexcept {
-            return iterator<inv_side>(static_cast<node_heavy *>(cur_node), tree_root);
+        template<typename T>
+        discard_output &operator=(T &&) noexcept {
+            return *this;
         }
-
     };
 
-    using left_iterator = iterator<tag_key>;
-    using right_iterator = iterator<tag_value>;
-
-    // Создает bimap не содержащий ни одной пары.
-    explicit bimap(CompareLeft compare_left = CompareLeft(),
-          CompareRight compare_right = CompareRight()) : left_tree(compare_left), right_tree(compare_right) {};
-
-    //bimap() = default;
-
-    // Конструкторы от других и присваивания
-    bimap(bimap const &other) : left_tree(other.left_tree.cmp), right_tree(other.right_tree.cmp) {
-        auto it = other.begin_left();
-        while (it != other.end_left()) {
-            this->insert(*it, *it.flip());
-            ++it;
+public:
+    // Вставляет пары (left, right) из диапазона разом: узлы упорядочиваются,
+    // собираются в treap'ы за линейное время и объединяются с деревьями
+    // bimap за O(m log(n / m + 1)). Отбрасываются пары, чей left или right
+    // уже есть в bimap; из остальных пар пачки с одинаковым left остается
+    // первая, затем из оставшихся с одинаковым right -- тоже первая, как в
+    // конструкторе от диапазона. Отброшенные пары в порядке входа пишутся
+    // в rejected как std::pair<Left, Right>. Возвращает количество вставленных пар.
+    template<typename InputIt, typename OutputIt>
+    size_t insert_batch(InputIt first, InputIt last, OutputIt rejected) {
+        std::vector<node_heavy *> nodes;
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                typename std::iterator_traits<InputIt>::iterator_category>) {
+            auto n = static_cast<size_t>(std::distance(first, last));
+            nodes.reserve(n);
+            pool.reserve(n);
         }
-    };
-
-    bimap(bimap &&other) noexcept: left_tree(std::move(other.left_tree)), right_tree(std::move(other.right_tree)),
-                                   pair_count(std::move(other.pair_count)) {};
+        // До объединения деревья не тронуты: при исключении узлы пачки освобождаются.
+        std::vector<char> dropped;
+        std::vector<node_heavy *> left_order;
+        std::vector<node_heavy *> right_order;
+        try {
+            for (; first != last; ++first) {
+                auto &&p = *first;
+                nodes.push_back(pool.create(next_priority(), std::forward<decltype(p)>(p).first,
+                                            std::forward<decltype(p)>(p).second));
+            }
 
-    bimap &operator=(bimap const &other) {
-        auto it = begin_left();
-        while (it != end_left()) {
-            auto tmp = it;
-            ++tmp;
-            erase_left(it);
-            it = tmp;
-        }
-        // this->left_tree(other.left_tree.cmp);
-        // this->right_tree(other.right_tree.cmp);
-        //  this->pair_count = other.pair_count;
-        auto it1 = other.begin_left();
-        while (it1 != other.end_left()) {
-            this->insert(*it1, *it1.flip());
-            ++it1;
+            dropped.assign(nodes.size(), false);
+            auto by_left = sorted_indices(nodes, left_tree);
+            auto by_right = sorted_indices(nodes, right_tree);
+            drop_existing(left_tree, nodes, by_left, dropped);
+            drop_existing(right_tree, nodes, by_right, dropped);
+            drop_equal(left_tree, nodes, by_left, dropped);
+            drop_equal(right_tree, nodes, by_right, dropped);
+
+            for (auto i : by_left) {
+                if (!dropped[i]) {
+                    left_order.push_back(nodes[i]);
+                }
+            }
+            for (auto i : by_right) {
+                if (!dropped[i]) {
+                    right_order.push_back(nodes[i]);
+                }
+            }
+        } catch (...) {
+            for (auto node : nodes) {
+                pool.destroy(node);
+            }
+            throw;
         }
-        return *this;
+        Treap<Left, tag_key, CompareLeft> batch_left(left_tree.cmp);
+        Treap<Right, tag_value, CompareRight> batch_right(right_tree.cmp);
+        batch_left.build(left_order.begin(), left_order.end());
+        batch_right.build(right_order.begin(), right_order.end());
+        left_tree.set_root(left_tree.unite(left_tree.root(), batch_left.root()));
+        right_tree.set_root(right_tree.unite(right_tree.root(), batch_right.root()));
+        pair_count += left_order.size();
+
+        // Пачка уже в деревьях: если rejected бросит, остальные
+        // отвергнутые узлы освобождаются, а исключение уходит дальше.
+        size_t i = 0;
+        try {
+            for (; i < nodes.size(); i++) {
+                if (dropped[i]) {
+                    node_heavy *node = nodes[i];
+                    *rejected = std::pair<Left, Right>(std::move(node->node_light<Left, tag_key>::data),
+                                                       std::move(node->node_light<Right, tag_value>::data));
+                    ++rejected;
+                    pool.destroy(node);
+                }
+            }
+        } catch (...) {
+            for (; i < nodes.size(); i++) {
+                if (dropped[i]) {
+                    pool.destroy(nodes[i]);
+                }
+            }
+            throw;
+        }
+        return left_order.size();
     }
 
-    bimap &operator=(bimap &&other) {
-        auto it = begin_left();
-        while (it != end_left()) {
-            auto tmp = it;
-            ++tmp;
-            erase_left(it);
-            it = tmp;
-        }
-        std::swap(this->pair_count, other.pair_count);
-        std::swap(this->left_tree, other.left_tree);
-        std::swap(this->right_tree, other.right_tree);
-        return *this;
-    };
+    template<typename InputIt>
+    size_t insert_batch(InputIt first, InputIt last) {
+        return insert_batch(first, last, discard_output());
+    }
 
-    // Деструктор. Вызывается при удалении объектов bimap.
-    // Инвалидирует все итераторы ссылающиеся на элементы этого bimap
-    // (включая итераторы ссылающиеся на элементы следующие за последними).
-    ~bimap() {
-        left_tree.destroy();
-    };
 private:
-    void erase_test(left_t const &left) {
-        auto fake = static_cast<node_heavy *>(left_tree.exists(left));
-        left_tree.erase(fake->node_light<Left, tag_key>::data);
-        right_tree.erase(fake->node_light<Right, tag_value>::data);
-        delete fake;
+    // Удаляет пары [first, last) дерева t (last == t.end() -- до конца)
+    // за O(log n + k): t делится по ключам first и last, средняя часть
+    // вырезается целиком, и при ее обходе парные узлы отцепляются от other.
+    template<typename Own, typename Other>
+    void cut_range(Own &t, Other &other, typename Own::node_t first, typename Own::node_t last) {
+        auto [less, rest] = t.split(t.root(), first->data);
+        auto middle = std::exchange(rest, nullptr);
+        if (last != t.end()) {
+            std::tie(middle, rest) = t.split(middle, last->data);
+        }
+        t.set_root(t.merge(less, rest));
+        Own::drain(middle, [&](typename Own::node_t node) noexcept {
+            auto pair = static_cast<node_heavy *>(node);
+            other.unlink(pair);
+            pool.destroy(pair);
+            pair_count--;
+        });
+    }
+
+    // Отцепляет пару от обоих деревьев, узел остается живым.
+    void unlink_pair(node_heavy *node) noexcept {
+        left_tree.unlink(node);
+        right_tree.unlink(node);
         pair_count--;
     }
 
+    void erase_node(node_heavy *node) noexcept {
+        count_operation();
+        unlink_pair(node);
+        pool.destroy(node);
+    }
+
+    // Подвешивает узел в оба дерева, его ключей там быть не должно.
     left_iterator inner_insert(node_heavy *node) {
-        if (left_tree.exists(*left_iterator(node, static_cast<node_heavy*>(left_tree.root))) != nullptr || right_tree.exists(*right_iterator(node, static_cast<node_heavy*>(left_tree.root))) != nullptr) {
-            delete node;
-            return end_left();
-        }
-        // auto fake = new node_heavy(left, right);
         left_tree.insert(static_cast<node_light<Left, tag_key> *>(node));
         right_tree.insert(static_cast<node_light<Right, tag_value> *>(node));
         pair_count++;
-        return left_iterator(node, static_cast<node_heavy*>(left_tree.root));
+        return left_iterator(node);
     }
 
-public:
+    // Можно ли подвесить key прямо перед hint (t.end() -- конец дерева).
+    // В prev записывается предшественник hint. Эквивалентный соседу ключ
+    // тоже дает false, вызывающий тогда ищет его от корня.
+    template<typename T, typename side, typename cmp>
+    static bool fits_before(const Treap<T, side, cmp> &t, node_light<T, side> *hint, const T &key,
+                            node_light<T, side> *&prev) {
+        if (hint != t.end() && !t.cmp(key, hint->data)) {
+            return false;
+        }
+        prev = t.predecessor(hint);
+        return prev == nullptr || t.cmp(prev->data, key);
+    }
 
+public:
     // Вставка пары (left, right), возвращает итератор на left.
     // Если такой left или такой right уже присутствуют в bimap, вставка не
     // производится и возвращается end_left().
     left_iterator insert(left_t const &left, right_t const &right) {
-        auto fake = new node_heavy(left, right);
-        return inner_insert(fake);
-    };
+        return emplace(left, right);
+    }
 
     left_iterator insert(left_t const &left, right_t &&right) {
-        auto fake = new node_heavy(left, std::move(right));
-        return inner_insert(fake);
-    };
+        return emplace(left, std::move(right));
+    }
 
     left_iterator insert(left_t &&left, right_t const &right) {
-        auto fake = new node_heavy(std::move(left), right);
-        return inner_insert(fake);
-    };
+        return emplace(std::move(left), right);
+    }
 
     left_iterator insert(left_t &&left, right_t &&right) {
-        auto fake = new node_heavy(std::move(left), std::move(right));
-        return inner_insert(fake);
-    };
+        return emplace(std::move(left), std::move(right));
+    }
 
-private:
-    template<typename side, typename type, typename cmp>
-    iterator<side> erase_it(iterator<side> it, Treap<type, side, cmp> &t,
-                            Treap<typename std::conditional<std::is_same_v<type, left_t>, right_t, left_t>::type,
-                                    typename std::conditional<std::is_same_v<side, tag_key>, tag_value, tag_key>::type,
-                                    typename std::conditional<std::is_same_v<cmp, CompareLeft>, CompareRight, CompareLeft>::type> &t_inv) {
-        auto node = static_cast<node_heavy *>(it.cur_node);
-        auto tmp = it;
-        type val = *it;
-        ++tmp;
-        t.erase(val);
-        t_inv.erase(*it.flip());
-        pair_count--;
-        delete node;
-        return tmp;
+    // Как insert, но left и right -- аргументы конструкторов ключей. Ключи
+    // ищутся до того, как пул выдаст узел: отвергнутая пара не трогает пул
+    // и не копируется. Аргументы другого типа сначала превращаются
+    // во временные ключи.
+    template<typename L, typename R>
+    left_iterator emplace(L &&left, R &&right) {
+        if constexpr (std::is_same_v<std::decay_t<L>, left_t> && std::is_same_v<std::decay_t<R>, right_t>) {
+            count_operation();
+            if (left_tree.exists(left) != nullptr || right_tree.exists(right) != nullptr) {
+                return end_left();
+            }
+            return inner_insert(pool.create(next_priority(), std::forward<L>(left), std::forward<R>(right)));
+        } else {
+            return emplace(left_t(std::forward<L>(left)), right_t(std::forward<R>(right)));
+        }
+    }
+
+    // Вставка с подсказками: пара встает прямо перед hint_left в левом
+    // дереве и перед hint_right в правом. Верная подсказка избавляет от
+    // спуска от корня: узел подвешивается листом рядом с ней и поднимается
+    // поворотами, которых в среднем O(1). Для отсортированного входа
+    // подсказка -- end_left()/end_right(). Неверная подсказка не ломает
+    // вставку, сторона просто вставляется как в insert.
+    template<typename L, typename R>
+    left_iterator insert(left_iterator hint_left, right_iterator hint_right, L &&left, R &&right) {
+        if constexpr (std::is_same_v<std::decay_t<L>, left_t> && std::is_same_v<std::decay_t<R>, right_t>) {
+            count_operation();
+            left_node *left_prev = nullptr;
+            right_node *right_prev = nullptr;
+            bool left_fits = fits_before(left_tree, hint_left.cur_node, left, left_prev);
+            bool right_fits = fits_before(right_tree, hint_right.cur_node, right, right_prev);
+            if ((!left_fits && left_tree.exists(left) != nullptr) ||
+                (!right_fits && right_tree.exists(right) != nullptr)) {
+                return end_left();
+            }
+            node_heavy *node = pool.create(next_priority(), std::forward<L>(left), std::forward<R>(right));
+            if (left_fits) {
+                left_tree.insert_before(hint_left.cur_node, left_prev, node);
+            } else {
+                left_tree.insert(node);
+            }
+            if (right_fits) {
+                right_tree.insert_before(hint_right.cur_node, right_prev, node);
+            } else {
+                right_tree.insert(node);
+            }
+            pair_count++;
+            return left_iterator(node);
+        } else {
+            return insert(hint_left, hint_right, left_t(std::forward<L>(left)), right_t(std::forward<R>(right)));
+        }
+    }
+
+    // Вставка узла, вынутого extract_left/extract_right. Узел из этого же
+    // bimap возвращается в деревья на своем месте, без обращений к
+    // аллокатору. Из другого bimap ключи перемещаются в узел пула, а слот
+    // возвращается владельцу. При неудаче handle остается
+    // в insert_return_type::node.
+    insert_return_type insert(node_type &&nh) {
+        count_operation();
+        if (nh.empty()) {
+            return {end_left(), false, node_type()};
+        }
+        if (left_tree.exists(nh.left()) != nullptr || right_tree.exists(nh.right()) != nullptr) {
+            return {end_left(), false, std::move(nh)};
+        }
+        node_heavy *node;
+        if (nh.home->pool == &pool) {
+            nh.home->handles--;
+            nh.home = nullptr;
+            node = std::exchange(nh.node, nullptr);
+        } else {
+            node = pool.create(nh.node->priority, std::move(nh.left()), std::move(nh.right()));
+            nh.reset();
+        }
+        return {inner_insert(node), true, node_type()};
     }
 
 public:
@@ -440,51 +2147,115 @@ public:
     // erase(end_left()) и erase(end_right()) неопределены.
     // Пусть it ссылается на некоторый элемент e.
     // erase инвалидирует все итераторы ссылающиеся на e и на элемент парный к e.
+    // Узел берется из итератора, деревья не просматриваются от корня.
     left_iterator erase_left(left_iterator it) {
-        return erase_it(it, left_tree, right_tree);
+        auto next = std::next(it);
+        erase_node(static_cast<node_heavy *>(it.cur_node));
+        return next;
     };
 
     right_iterator erase_right(right_iterator it) {
-        return erase_it(it, right_tree, left_tree);
+        auto next = std::next(it);
+        erase_node(static_cast<node_heavy *>(it.cur_node));
+        return next;
     };
 
     // Аналогично erase, но по ключу, удаляет элемент если он присутствует, иначе
     // не делает ничего Возвращает была ли пара удалена
     bool erase_left(left_t const &left) {
-        node_light<Left, tag_key> *cur = left_tree.exists(left);
-        if (cur != nullptr) {
-            auto fake = static_cast<node_heavy *>(cur);
-            left_tree.erase(left);
-            right_tree.erase(fake->node_light<Right, tag_value>::data); // todo prolly should use iterator
-            pair_count--;
-            delete fake;
-            return true;
-        }
-        return false;
+        return erase_key(left_tree, left);
     };
 
-
     bool erase_right(right_t const &right) {
-        node_light<Right, tag_value> *cur = right_tree.exists(right);
+        return erase_key(right_tree, right);
+    };
+
+    // Перегрузки по ключу с параметром K (здесь и ниже) есть только для
+    // прозрачных компараторов (с is_transparent) и ищут без временного
+    // ключа. Эквивалентность ключей везде проверяется компаратором.
+    template<typename K, typename C = CompareLeft, typename = typename C::is_transparent>
+    bool erase_left(K const &left) {
+        return erase_key(left_tree, left);
+    }
+
+    template<typename K, typename C = CompareRight, typename = typename C::is_transparent>
+    bool erase_right(K const &right) {
+        return erase_key(right_tree, right);
+    }
+
+private:
+    template<typename Tree, typename K>
+    bool erase_key(Tree &t, K const &key) {
+        auto cur = t.exists(key);
         if (cur != nullptr) {
-            return erase_left(*(right_iterator(cur, static_cast<node_heavy*>(left_tree.root)).flip()));
+            erase_node(static_cast<node_heavy *>(cur));
+            return true;
         }
+        count_operation();
         return false;
-    };
+    }
+
+    template<typename Tree, typename K>
+    node_type extract_key(Tree &t, K const &key) {
+        auto cur = t.exists(key);
+        if (cur == nullptr) {
+            count_operation();
+            return node_type();
+        }
+        return extract_node(static_cast<node_heavy *>(cur));
+    }
+
+    // anchor берется до того, как пара покидает деревья: если аллокатор
+    // бросит, bimap не изменится.
+    node_type extract_node(node_heavy *node) {
+        count_operation();
+        auto home = pool.get_anchor();
+        unlink_pair(node);
+        home->handles++;
+        return node_type(node, home);
+    }
+
+public:
+    // Вынимает пару в node_type вместе с ее узлом, без обращений к
+    // аллокатору (кроме первого extract из пула). Инвалидирует итераторы
+    // на вынутую пару. По ключу возвращает пустой handle, если ключа нет.
+    node_type extract_left(left_iterator it) {
+        return extract_node(static_cast<node_heavy *>(it.cur_node));
+    }
+
+    node_type extract_right(right_iterator it) {
+        return extract_node(static_cast<node_heavy *>(it.cur_node));
+    }
+
+    node_type extract_left(left_t const &left) {
+        return extract_key(left_tree, left);
+    }
+
+    node_type extract_right(right_t const &right) {
+        return extract_key(right_tree, right);
+    }
+
+    template<typename K, typename C = CompareLeft, typename = typename C::is_transparent>
+    node_type extract_left(K const &left) {
+        return extract_key(left_tree, left);
+    }
+
+    template<typename K, typename C = CompareRight, typename = typename C::is_transparent>
+    node_type extract_right(K const &right) {
+        return extract_key(right_tree, right);
+    }
 
     template<typename side, typename type, typename cmp>
     iterator<side> erase_range(iterator<side> first, iterator<side> last) {
-        auto it = first;
-        while (it != last) {
-            auto next = ++it;
-            if constexpr (std::is_same_v<side, tag_key>) {
-                erase_left(--it);
-            } else {
-                erase_right(--it);
-            }
-            it = next;
+        if (first == last) {
+            return last;
+        }
+        if constexpr (std::is_same_v<side, tag_key>) {
+            cut_range(left_tree, right_tree, first.cur_node, last.cur_node);
+        } else {
+            cut_range(right_tree, left_tree, first.cur_node, last.cur_node);
         }
-        return it;
+        return iterator<side>(last.cur_node);
     }
 
 
@@ -498,12 +2269,13 @@ public:
         return erase_range<tag_value, right_t, CompareRight>(first, last);
     };
 
-    template<typename side, typename type, typename cmp>
-    iterator<side> find(type const &key, const Treap<type, side, cmp> &t, iterator<side> end) const {
+    template<typename side, typename type, typename cmp, typename K>
+    iterator<side> find(K const &key, const Treap<type, side, cmp> &t, iterator<side> end) const {
+        count_operation();
         auto node = t.exists(key);
         if (node == nullptr)
             return end;
-        return iterator<side>(node, static_cast<node_heavy*>(left_tree.root));
+        return iterator<side>(node);
     }
 
     // Возвращает итератор по элементу. Если не найден - соответствующий end()
@@ -515,14 +2287,25 @@ public:
         return find(right, right_tree, end_right());
     };
 
+    template<typename K, typename C = CompareLeft, typename = typename C::is_transparent>
+    left_iterator find_left(K const &left) const {
+        return find(left, left_tree, end_left());
+    }
+
+    template<typename K, typename C = CompareRight, typename = typename C::is_transparent>
+    right_iterator find_right(K const &right) const {
+        return find(right, right_tree, end_right());
+    }
+
 
-    template<typename side, typename type, typename cmp, typename inv_type>
-    inv_type const &at(type const &key, const Treap<type, side, cmp> &t) const {
+    template<typename side, typename type, typename cmp, typename inv_type, typename K>
+    inv_type const &at(K const &key, const Treap<type, side, cmp> &t) const {
+        count_operation();
         auto node = t.exists(key);
         if (node == nullptr) {
             throw std::out_of_range("Bruh");
         }
-        return *iterator<side>(node, static_cast<node_heavy*>(left_tree.root)).flip();
+        return *iterator<side>(node).flip();
     }
 
     // Возвращает противоположный элемент по элементу
@@ -535,6 +2318,16 @@ public:
         return at<tag_value, right_t, CompareRight, left_t>(key, right_tree);
     };
 
+    template<typename K, typename C = CompareLeft, typename = typename C::is_transparent>
+    right_t const &at_left(K const &key) const {
+        return at<tag_key, left_t, CompareLeft, right_t>(key, left_tree);
+    }
+
+    template<typename K, typename C = CompareRight, typename = typename C::is_transparent>
+    left_t const &at_right(K const &key) const {
+        return at<tag_value, right_t, CompareRight, left_t>(key, right_tree);
+    }
+
     // Возвращает противоположный элемент по элементу
     // Если элемента не существует, добавляет его в bimap и на противоположную
     // сторону кладет дефолтный элемент, ссылку на который и возвращает
@@ -549,11 +2342,11 @@ public:
             auto default_right = right_t();
             auto n_right = this->right_tree.exists(default_right);
             if (n_right != nullptr) {
-                erase_right(right_iterator(n_right, static_cast<node_heavy*>(left_tree.root)));
+                erase_right(right_iterator(n_right));
             }
             return *(insert(key, default_right).flip());
         } else {
-            return *left_iterator(node, static_cast<node_heavy*>(left_tree.root)).flip();
+            return *left_iterator(node).flip();
         }
     }
 
@@ -566,109 +2359,145 @@ public:
             auto default_left = left_t();
             auto n_left = this->left_tree.exists(default_left);
             if (n_left != nullptr) {
-                erase_left(left_iterator(n_left, static_cast<node_heavy*>(left_tree.root)));
+                erase_left(left_iterator(n_left));
             }
             return *(insert(default_left, key));
         } else {
-            return *right_iterator(node, static_cast<node_heavy*>(left_tree.root)).flip();
+            return *right_iterator(node).flip();
         }
     }
 
     // lower и upper bound'ы по каждой стороне
     // Возвращают итераторы на соответствующие элементы
     // Смотри std::lower_bound, std::upper_bound.
-private:
-    template<typename side, typename type, typename cmp>
-    iterator<side> lower_bound(iterator<side> begin, const Treap<type, side, cmp> &t, type key) const {
-        int dist = size();
-        auto first = begin;
-        while (dist > 0) {
-            auto it = first;
-            auto hop = dist / 2;
-            for (int i = 0; i < hop; i++) {
-                ++it;
-            }
-            if (t.cmp(*it, key)) {
-                first = ++it;
-                dist -= (hop + 1);
-            } else {
-                dist = hop;
-            }
-        }
-        return first;
-    }
-
-    template<typename side, typename type, typename cmp>
-    iterator<side> upper_bound(iterator<side> begin, const Treap<type, side, cmp> &t, type key) const {
-        int dist = size();
-        auto first = begin;
-        while (dist > 0) {
-            auto it = first;
-            auto hop = dist / 2;
-            for (int i = 0; i < hop; i++) {
-                ++it;
-            }
-            if (!t.cmp(key, *it)) {
-                first = ++it;
-                dist -= (hop + 1);
-            } else {
-                dist = hop;
-            }
-        }
-        return first;
-    }
-
-public:
     left_iterator lower_bound_left(const left_t &left) const {
-        return lower_bound(begin_left(), left_tree, left);
+        count_operation();
+        return left_iterator(left_tree.or_end(left_tree.lower_bound(left)));
     };
 
     left_iterator upper_bound_left(const left_t &left) const {
-        return upper_bound(begin_left(), left_tree, left);
+        count_operation();
+        return left_iterator(left_tree.or_end(left_tree.upper_bound(left)));
     };
 
     right_iterator lower_bound_right(const right_t &right) const {
-        return lower_bound(begin_right(), right_tree, right);
+        count_operation();
+        return right_iterator(right_tree.or_end(right_tree.lower_bound(right)));
     };
 
     right_iterator upper_bound_right(const right_t &right) const {
-        return upper_bound(begin_right(), right_tree, right);
+        count_operation();
+        return right_iterator(right_tree.or_end(right_tree.upper_bound(right)));
+    };
+
+    template<typename K, typename C = CompareLeft, typename = typename C::is_transparent>
+    left_iterator lower_bound_left(const K &left) const {
+        count_operation();
+        return left_iterator(left_tree.or_end(left_tree.lower_bound(left)));
+    }
+
+    template<typename K, typename C = CompareLeft, typename = typename C::is_transparent>
+    left_iterator upper_bound_left(const K &left) const {
+        count_operation();
+        return left_iterator(left_tree.or_end(left_tree.upper_bound(left)));
+    }
+
+    template<typename K, typename C = CompareRight, typename = typename C::is_transparent>
+    right_iterator lower_bound_right(const K &right) const {
+        count_operation();
+        return right_iterator(right_tree.or_end(right_tree.lower_bound(right)));
+    }
+
+    template<typename K, typename C = CompareRight, typename = typename C::is_transparent>
+    right_iterator upper_bound_right(const K &right) const {
+        count_operation();
+        return right_iterator(right_tree.or_end(right_tree.upper_bound(right)));
+    }
+
+private:
+    template<typename side, typename type, typename cmp, typename K>
+    std::pair<iterator<side>, iterator<side>> equal_range(const Treap<type, side, cmp> &t, const K &key) const {
+        count_operation();
+        auto first = iterator<side>(t.or_end(t.lower_bound(key)));
+        auto last = first;
+        if (first.cur_node != t.end() && !t.cmp(key, *first)) {
+            ++last;
+        }
+        return {first, last};
+    }
+
+public:
+    // Диапазон элементов, эквивалентных ключу. Смотри std::map::equal_range.
+    std::pair<left_iterator, left_iterator> equal_range_left(const left_t &left) const {
+        return equal_range(left_tree, left);
+    };
+
+    std::pair<right_iterator, right_iterator> equal_range_right(const right_t &right) const {
+        return equal_range(right_tree, right);
     };
 
+    template<typename K, typename C = CompareLeft, typename = typename C::is_transparent>
+    std::pair<left_iterator, left_iterator> equal_range_left(const K &left) const {
+        return equal_range(left_tree, left);
+    }
+
+    template<typename K, typename C = CompareRight, typename = typename C::is_transparent>
+    std::pair<right_iterator, right_iterator> equal_range_right(const K &right) const {
+        return equal_range(right_tree, right);
+    }
+
+    // Порядковые статистики, доступны с политикой order_statistics.
+    // nth_* возвращает итератор на k-й (с нуля) элемент или end, если k >= size().
+    // rank_* возвращает количество элементов, меньших key.
+    template<typename P = Policy, typename = std::enable_if_t<P::order_statistics>>
+    left_iterator nth_left(size_t k) const noexcept {
+        return left_iterator(left_tree.or_end(left_tree.select(left_tree.root(), k)));
+    }
+
+    template<typename P = Policy, typename = std::enable_if_t<P::order_statistics>>
+    right_iterator nth_right(size_t k) const noexcept {
+        return right_iterator(right_tree.or_end(right_tree.select(right_tree.root(), k)));
+    }
+
+    template<typename P = Policy, typename = std::enable_if_t<P::order_statistics>>
+    size_t rank_left(const left_t &key) const {
+        return left_tree.rank(key);
+    }
+
+    template<typename P = Policy, typename = std::enable_if_t<P::order_statistics>>
+    size_t rank_right(const right_t &key) const {
+        return right_tree.rank(key);
+    }
+
     // Возващает итератор на минимальный по порядку left.
+    // begin и end берутся из заголовка дерева за O(1).
     left_iterator begin_left() const noexcept {
-        node_light<Left, tag_key> *cur = left_tree.root;
-        if (cur != nullptr) {
-            while (cur->left != nullptr) {
-                cur = cur->left;
-            }
-            return left_iterator(cur, static_cast<node_heavy*>(left_tree.root));
-        }
-        return end_left();
+        return left_iterator(left_tree.leftmost);
     };
 
     // Возващает итератор на следующий за последним по порядку left.
     left_iterator end_left() const noexcept {
-        return left_iterator(nullptr, static_cast<node_heavy*>(left_tree.root));
+        return left_iterator(left_tree.end());
     }
 
     // Возващает итератор на минимальный по порядку right.
     right_iterator begin_right() const noexcept {
-        node_light<Right, tag_value> *cur = right_tree.root;
-        if (cur != nullptr) {
-            while (cur->left != nullptr) {
-                cur = cur->left;
-            }
-            return right_iterator(cur, static_cast<node_heavy*>(left_tree.root));
-        }
-        return end_right();
+        return right_iterator(right_tree.leftmost);
     };
 
     // Возващает итератор на следующий за последним по порядку right.
     right_iterator end_right() const noexcept {
-        return right_iterator(nullptr, static_cast<node_heavy*>(left_tree.root));
+        return right_iterator(right_tree.end());
     };
 
+    using frozen_type = frozen_bimap<Left, Right, CompareLeft, CompareRight>;
+
+    // Неизменяемая копия для частых чтений, см. frozen_bimap.
+    // Итераторы снимка не связаны с этим bimap.
+    frozen_type freeze() const {
+        return frozen_type(*this, left_tree.cmp, right_tree.cmp);
+    }
+
     // Проверка на пустоту
     [[nodiscard]] bool empty() const noexcept {
         return pair_count == 0;
@@ -682,10 +2511,10 @@ public:
 };
 
 // операторы сравнения
-template<typename Left, typename Right, typename CompareLeft = std::less<Left>,
-        typename CompareRight = std::less<Right>>
-bool operator==(bimap<Left, Right, CompareLeft, CompareRight> const &a,
-                bimap<Left, Right, CompareLeft, CompareRight> const &b) {
+template<typename Left, typename Right, typename CompareLeft, typename CompareRight, typename Allocator,
+        typename Policy>
+bool operator==(bimap<Left, Right, CompareLeft, CompareRight, Allocator, Policy> const &a,
+                bimap<Left, Right, CompareLeft, CompareRight, Allocator, Policy> const &b) {
     if (a.size() != b.size()) {
         return false;
     }
@@ -701,9 +2530,9 @@ bool operator==(bimap<Left, Right, CompareLeft, CompareRight> const &a,
     return true;
 }
 
-template<typename Left, typename Right, typename CompareLeft = std::less<Left>,
-        typename CompareRight = std::less<Right>>
-bool operator!=(bimap<Left, Right, CompareLeft, CompareRight> const &a,
-                bimap<Left, Right, CompareLeft, CompareRight> const &b) {
+template<typename Left, typename Right, typename CompareLeft, typename CompareRight, typename Allocator,
+        typename Policy>
+bool operator!=(bimap<Left, Right, CompareLeft, CompareRight, Allocator, Policy> const &a,
+                bimap<Left, Right, CompareLeft, CompareRight, Allocator, Policy> const &b) {
     return !(a == b);
 }
@@ -0,0 +1,566 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "dense_store.h"
+
+// Упорядоченный bimap с компактными узлами для мелких ключей.
+// Пары лежат подряд в одном хранилище, оба treap'а связаны 32-битными
+// индексами вместо указателей, приоритет один на пару, пустые компараторы
+// не занимают места. Для <uint32_t, uint32_t> пара занимает 36 байт против
+// 64 у узла bimap. Удаление, как в unordered_bimap, переносит последнюю
+// пару на место удаленной, поэтому итераторы на нее инвалидируются.
+// Пар не больше 2^32 - 1.
+template<typename Left, typename Right, typename CompareLeft = std::less<Left>,
+        typename CompareRight = std::less<Right>>
+struct compact_bimap {
+
+    using left_t = Left;
+    using right_t = Right;
+
+    struct tag_key {
+    };
+    struct tag_value {
+    };
+
+private:
+    static constexpr std::uint32_t nil = std::numeric_limits<std::uint32_t>::max();
+
+    struct links {
+        std::uint32_t left = nil;
+        std::uint32_t right = nil;
+        std::uint32_t parent = nil;
+    };
+
+    struct entry {
+        Left left;
+        Right right;
+        links left_links;
+        links right_links;
+        std::uint32_t priority;
+    };
+
+    // Treap одной стороны поверх общего хранилища. Компаратор -- база:
+    // пустой не добавляет к размеру ничего (EBO).
+    template<typename T, typename Compare, T entry::*key, links entry::*link>
+    struct index_tree : Compare {
+        std::uint32_t root = nil;
+
+        explicit index_tree(Compare const &cmp) : Compare(cmp) {}
+
+        template<typename A, typename B>
+        bool less(A const &a, B const &b) const {
+            return static_cast<Compare const &>(*this)(a, b);
+        }
+
+        static links &at(entry *d, std::uint32_t i) noexcept {
+            return d[i].*link;
+        }
+
+        static links const &at(entry const *d, std::uint32_t i) noexcept {
+            return d[i].*link;
+        }
+
+        static T const &key_of(entry const *d, std::uint32_t i) noexcept {
+            return d[i].*key;
+        }
+
+        // Ячейка, в которой лежит ссылка на ребенка i узла parent.
+        std::uint32_t &child_slot(entry *d, std::uint32_t parent, std::uint32_t i) noexcept {
+            if (parent == nil) {
+                return root;
+            }
+            links &p = at(d, parent);
+            return p.left == i ? p.left : p.right;
+        }
+
+        template<typename K>
+        std::uint32_t find(entry const *d, K const &val) const {
+            std::uint32_t t = root;
+            while (t != nil) {
+                bool lt = less(val, key_of(d, t));
+                bool gt = less(key_of(d, t), val);
+                if (lt == gt) {
+                    break;
+                }
+                t = lt ? at(d, t).left : at(d, t).right;
+            }
+            return t;
+        }
+
+        template<typename K>
+        std::uint32_t lower_bound(entry const *d, K const &val) const {
+            std::uint32_t t = root;
+            std::uint32_t result = nil;
+            while (t != nil) {
+                if (less(key_of(d, t), val)) {
+                    t = at(d, t).right;
+                } else {
+                    result = t;
+                    t = at(d, t).left;
+                }
+            }
+            return result;
+        }
+
+        template<typename K>
+        std::uint32_t upper_bound(entry const *d, K const &val) const {
+            std::uint32_t t = root;
+            std::uint32_t result = nil;
+            while (t != nil) {
+                if (less(val, key_of(d, t))) {
+                    result = t;
+                    t = at(d, t).left;
+                } else {
+                    t = at(d, t).right;
+                }
+            }
+            return result;
+        }
+
+        std::uint32_t first(entry const *d) const noexcept {
+            std::uint32_t t = root;
+            while (t != nil && at(d, t).left != nil) {
+                t = at(d, t).left;
+            }
+            return t;
+        }
+
+        std::uint32_t last(entry const *d) const noexcept {
+            std::uint32_t t = root;
+            while (t != nil && at(d, t).right != nil) {
+                t = at(d, t).right;
+            }
+            return t;
+        }
+
+        static std::uint32_t next(entry const *d, std::uint32_t i) noexcept {
+            if (at(d, i).right != nil) {
+                i = at(d, i).right;
+                while (at(d, i).left != nil) {
+                    i = at(d, i).left;
+                }
+                return i;
+            }
+            std::uint32_t p = at(d, i).parent;
+            while (p != nil && at(d, p).right == i) {
+                i = p;
+                p = at(d, p).parent;
+            }
+            return p;
+        }
+
+        static std::uint32_t prev(entry const *d, std::uint32_t i) noexcept {
+            if (at(d, i).left != nil) {
+                i = at(d, i).left;
+                while (at(d, i).right != nil) {
+                    i = at(d, i).right;
+                }
+                return i;
+            }
+            std::uint32_t p = at(d, i).parent;
+            while (p != nil && at(d, p).left == i) {
+                i = p;
+                p = at(d, p).parent;
+            }
+            return p;
+        }
+
+        // Делит поддерево t на ключи меньше val и остальные.
+        std::pair<std::uint32_t, std::uint32_t> split(entry *d, std::uint32_t t, T const &val) const {
+            std::uint32_t lo = nil;
+            std::uint32_t hi = nil;
+            std::uint32_t *lo_slot = &lo;
+            std::uint32_t *hi_slot = &hi;
+            std::uint32_t lo_parent = nil;
+            std::uint32_t hi_parent = nil;
+            while (t != nil) {
+                if (less(key_of(d, t), val)) {
+                    *lo_slot = t;
+                    at(d, t).parent = lo_parent;
+                    lo_parent = t;
+                    lo_slot = &at(d, t).right;
+                    t = *lo_slot;
+                } else {
+                    *hi_slot = t;
+                    at(d, t).parent = hi_parent;
+                    hi_parent = t;
+                    hi_slot = &at(d, t).left;
+                    t = *hi_slot;
+                }
+            }
+            *lo_slot = nil;
+            *hi_slot = nil;
+            return {lo, hi};
+        }
+
+        // Сливает деревья a и b, все ключи a меньше ключей b.
+        static std::uint32_t merge(entry *d, std::uint32_t a, std::uint32_t b) noexcept {
+            std::uint32_t result = nil;
+            std::uint32_t *slot = &result;
+            std::uint32_t parent = nil;
+            while (a != nil && b != nil) {
+                if (d[a].priority >= d[b].priority) {
+                    *slot = a;
+                    at(d, a).parent = parent;
+                    parent = a;
+                    slot = &at(d, a).right;
+                    a = *slot;
+                } else {
+                    *slot = b;
+                    at(d, b).parent = parent;
+                    parent = b;
+                    slot = &at(d, b).left;
+                    b = *slot;
+                }
+            }
+            std::uint32_t rest = a != nil ? a : b;
+            *slot = rest;
+            if (rest != nil) {
+                at(d, rest).parent = parent;
+            }
+            return result;
+        }
+
+        // Ключа узла i в дереве быть не должно.
+        void insert(entry *d, std::uint32_t i) {
+            std::uint32_t parent = nil;
+            std::uint32_t *slot = &root;
+            while (*slot != nil && d[*slot].priority >= d[i].priority) {
+                parent = *slot;
+                slot = less(key_of(d, i), key_of(d, parent)) ? &at(d, parent).left : &at(d, parent).right;
+            }
+            auto [lo, hi] = split(d, *slot, key_of(d, i));
+            at(d, i) = {lo, hi, parent};
+            if (lo != nil) {
+                at(d, lo).parent = i;
+            }
+            if (hi != nil) {
+                at(d, hi).parent = i;
+            }
+            *slot = i;
+        }
+
+        void unlink(entry *d, std::uint32_t i) noexcept {
+            links &l = at(d, i);
+            std::uint32_t child = merge(d, l.left, l.right);
+            child_slot(d, l.parent, i) = child;
+            if (child != nil) {
+                at(d, child).parent = l.parent;
+            }
+        }
+
+        // Узел from переезжает в ячейку to: перенаправляет ссылки на него.
+        void renumber(entry *d, std::uint32_t from, std::uint32_t to) noexcept {
+            links &l = at(d, from);
+            child_slot(d, l.parent, from) = to;
+            if (l.left != nil) {
+                at(d, l.left).parent = to;
+            }
+            if (l.right != nil) {
+                at(d, l.right).parent = to;
+            }
+        }
+    };
+
+    using left_tree = index_tree<Left, CompareLeft, &entry::left, &entry::left_links>;
+    using right_tree = index_tree<Right, CompareRight, &entry::right, &entry::right_links>;
+
+    dense_store<entry> store;
+    left_tree left_index;
+    right_tree right_index;
+    std::uint64_t priority_state;
+
+    template<typename side>
+    auto const &tree() const noexcept {
+        if constexpr (std::is_same_v<side, tag_key>) {
+            return left_index;
+        } else {
+            return right_index;
+        }
+    }
+
+public:
+    template<typename side>
+    struct iterator {
+        using type = typename std::conditional<std::is_same_v<side, tag_key>, left_t, right_t>::type;
+        using inv_side = typename std::conditional<std::is_same_v<side, tag_key>, tag_value, tag_key>::type;
+
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = type const *;
+        using reference = type const &;
+
+        const compact_bimap *owner;
+        std::uint32_t index;
+
+        iterator(const compact_bimap *owner, std::uint32_t index) noexcept: owner(owner), index(index) {}
+
+        type const &operator*() const noexcept {
+            if constexpr (std::is_same_v<side, tag_key>) {
+                return owner->store.data[index].left;
+            } else {
+                return owner->store.data[index].right;
+            }
+        }
+
+        type const *operator->() const noexcept {
+            return &**this;
+        }
+
+        iterator &operator++() noexcept {
+            index = owner->template tree<side>().next(owner->store.data, index);
+            return *this;
+        }
+
+        iterator operator++(int) noexcept {
+            iterator prev = *this;
+            ++*this;
+            return prev;
+        }
+
+        iterator &operator--() noexcept {
+            auto const &t = owner->template tree<side>();
+            index = index == nil ? t.last(owner->store.data) : t.prev(owner->store.data, index);
+            return *this;
+        }
+
+        iterator operator--(int) noexcept {
+            iterator prev = *this;
+            --*this;
+            return prev;
+        }
+
+        friend bool operator==(iterator first, iterator second) noexcept {
+            return first.index == second.index;
+        }
+
+        friend bool operator!=(iterator first, iterator second) noexcept {
+            return first.index != second.index;
+        }
+
+        iterator<inv_side> flip() const noexcept {
+            return iterator<inv_side>(owner, index);
+        }
+    };
+
+    using left_iterator = iterator<tag_key>;
+    using right_iterator = iterator<tag_value>;
+
+    explicit compact_bimap(CompareLeft compare_left = CompareLeft(), CompareRight compare_right = CompareRight())
+            : left_index(compare_left), right_index(compare_right),
+              priority_state(reinterpret_cast<std::uintptr_t>(this) * 0x9E3779B97F4A7C15ULL | 1) {}
+
+    compact_bimap(compact_bimap const &other) = default;
+
+    compact_bimap(compact_bimap &&other) noexcept
+            : store(std::move(other.store)), left_index(other.left_index), right_index(other.right_index),
+              priority_state(other.priority_state) {
+        other.left_index.root = nil;
+        other.right_index.root = nil;
+    }
+
+    compact_bimap &operator=(compact_bimap const &other) {
+        if (this != &other) {
+            compact_bimap copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    compact_bimap &operator=(compact_bimap &&other) noexcept {
+        std::swap(store, other.store);
+        std::swap(left_index, other.left_index);
+        std::swap(right_index, other.right_index);
+        std::swap(priority_state, other.priority_state);
+        return *this;
+    }
+
+    // Вставка пары (left, right), возвращает итератор на left.
+    // Если такой left или такой right уже присутствуют, вставка не
+    // производится и возвращается end_left().
+    left_iterator insert(left_t const &left, right_t const &right) {
+        return emplace(left, right);
+    }
+
+    left_iterator insert(left_t const &left, right_t &&right) {
+        return emplace(left, std::move(right));
+    }
+
+    left_iterator insert(left_t &&left, right_t const &right) {
+        return emplace(std::move(left), right);
+    }
+
+    left_iterator insert(left_t &&left, right_t &&right) {
+        return emplace(std::move(left), std::move(right));
+    }
+
+    // Удаляет пару и возвращает итератор на следующую. Итератор на пару,
+    // лежащую в хранилище последней, инвалидируется.
+    left_iterator erase_left(left_iterator it) {
+        return erase_at(it);
+    }
+
+    right_iterator erase_right(right_iterator it) {
+        return erase_at(it);
+    }
+
+    bool erase_left(left_t const &left) {
+        return erase_key(left_index, left);
+    }
+
+    bool erase_right(right_t const &right) {
+        return erase_key(right_index, right);
+    }
+
+    left_iterator find_left(left_t const &left) const {
+        return left_iterator(this, left_index.find(store.data, left));
+    }
+
+    right_iterator find_right(right_t const &right) const {
+        return right_iterator(this, right_index.find(store.data, right));
+    }
+
+    right_t const &at_left(left_t const &key) const {
+        std::uint32_t i = left_index.find(store.data, key);
+        if (i == nil) {
+            throw std::out_of_range("compact_bimap::at_left");
+        }
+        return store.data[i].right;
+    }
+
+    left_t const &at_right(right_t const &key) const {
+        std::uint32_t i = right_index.find(store.data, key);
+        if (i == nil) {
+            throw std::out_of_range("compact_bimap::at_right");
+        }
+        return store.data[i].left;
+    }
+
+    left_iterator lower_bound_left(const left_t &left) const {
+        return left_iterator(this, left_index.lower_bound(store.data, left));
+    }
+
+    left_iterator upper_bound_left(const left_t &left) const {
+        return left_iterator(this, left_index.upper_bound(store.data, left));
+    }
+
+    right_iterator lower_bound_right(const right_t &right) const {
+        return right_iterator(this, right_index.lower_bound(store.data, right));
+    }
+
+    right_iterator upper_bound_right(const right_t &right) const {
+        return right_iterator(this, right_index.upper_bound(store.data, right));
+    }
+
+    left_iterator begin_left() const noexcept {
+        return left_iterator(this, left_index.first(store.data));
+    }
+
+    left_iterator end_left() const noexcept {
+        return left_iterator(this, nil);
+    }
+
+    right_iterator begin_right() const noexcept {
+        return right_iterator(this, right_index.first(store.data));
+    }
+
+    right_iterator end_right() const noexcept {
+        return right_iterator(this, nil);
+    }
+
+    void reserve(size_t n) {
+        store.reserve(n);
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return store.size == 0;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return store.size;
+    }
+
+    // Байты, занятые хранилищем пар (вместе с резервом).
+    [[nodiscard]] std::size_t memory_usage() const noexcept {
+        return store.capacity * sizeof(entry);
+    }
+
+    friend bool operator==(compact_bimap const &a, compact_bimap const &b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (auto i = a.begin_left(), j = b.begin_left(); i != a.end_left(); ++i, ++j) {
+            if (a.left_index.less(*i, *j) || a.left_index.less(*j, *i) ||
+                a.right_index.less(*i.flip(), *j.flip()) || a.right_index.less(*j.flip(), *i.flip())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(compact_bimap const &a, compact_bimap const &b) {
+        return !(a == b);
+    }
+
+private:
+    // xorshift64*, как у bimap.
+    std::uint32_t next_priority() noexcept {
+        priority_state ^= priority_state >> 12;
+        priority_state ^= priority_state << 25;
+        priority_state ^= priority_state >> 27;
+        return static_cast<std::uint32_t>((priority_state * 0x2545F4914F6CDD1DULL) >> 32);
+    }
+
+    template<typename L, typename R>
+    left_iterator emplace(L &&left, R &&right) {
+        if (left_index.find(store.data, left) != nil || right_index.find(store.data, right) != nil) {
+            return end_left();
+        }
+        if (size() == nil) {
+            throw std::length_error("compact_bimap::insert");
+        }
+        store.push_back(std::forward<L>(left), std::forward<R>(right), links(), links(), next_priority());
+        auto index = static_cast<std::uint32_t>(size() - 1);
+        left_index.insert(store.data, index);
+        right_index.insert(store.data, index);
+        return left_iterator(this, index);
+    }
+
+    void remove(std::uint32_t index) {
+        auto last = static_cast<std::uint32_t>(size() - 1);
+        left_index.unlink(store.data, index);
+        right_index.unlink(store.data, index);
+        if (index != last) {
+            left_index.renumber(store.data, last, index);
+            right_index.renumber(store.data, last, index);
+        }
+        store.remove(index);
+    }
+
+    template<typename side>
+    iterator<side> erase_at(iterator<side> it) {
+        std::uint32_t next = tree<side>().next(store.data, it.index);
+        auto last = static_cast<std::uint32_t>(size() - 1);
+        remove(it.index);
+        return iterator<side>(this, next == last ? it.index : next);
+    }
+
+    template<typename Tree, typename T>
+    bool erase_key(Tree const &tree, T const &key) {
+        std::uint32_t i = tree.find(store.data, key);
+        if (i == nil) {
+            return false;
+        }
+        remove(i);
+        return true;
+    }
+};
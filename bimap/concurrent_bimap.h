@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "persistent_bimap.h"
+
+// Слот потока-читателя. В своей кеш-линии, чтобы читатели не мешали друг другу.
+struct alignas(64) reader_epoch_slot {
+    std::atomic<std::uint64_t> epoch{0};
+    std::atomic<bool> taken{false};
+};
+
+// Эпохи читателей, общие для всех concurrent_bimap. Поток при первом
+// чтении занимает слот и держит его до своего завершения. На входе в чтение
+// слот получает текущую глобальную эпоху, на выходе -- 0. Объект, снятый
+// с публикации и помеченный эпохой advance(), можно удалять, когда ни в
+// одном слоте нет меньшей ненулевой эпохи: все, кто мог его видеть, вышли.
+struct reader_epochs {
+    static constexpr size_t max_readers = 256;
+
+    using slot = reader_epoch_slot;
+
+    static inline slot slots[max_readers];
+    static inline std::atomic<std::uint64_t> global{1};
+
+    struct thread_slot {
+        slot *own = nullptr;
+        size_t depth = 0;
+
+        ~thread_slot() {
+            if (own != nullptr) {
+                own->taken.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    // Чтение без блокировок: запись эпохи в свой слот и обратно.
+    // Вложенные чтения не сдвигают эпоху внешнего.
+    struct guard {
+        thread_slot &current;
+
+        guard() : current(this_thread()) {
+            if (current.depth++ == 0) {
+                current.own->epoch.store(global.load());
+            }
+        }
+
+        guard(guard const &) = delete;
+
+        guard &operator=(guard const &) = delete;
+
+        ~guard() {
+            if (--current.depth == 0) {
+                current.own->epoch.store(0, std::memory_order_release);
+            }
+        }
+    };
+
+    // Начинает новую эпоху и возвращает ее: пометка для только что снятого объекта.
+    static std::uint64_t advance() noexcept {
+        return global.fetch_add(1) + 1;
+    }
+
+    // Наименьшая эпоха среди читающих потоков, если никто не читает -- максимум.
+    static std::uint64_t oldest_reader() noexcept {
+        std::uint64_t res = std::numeric_limits<std::uint64_t>::max();
+        for (auto const &s : slots) {
+            std::uint64_t e = s.epoch.load();
+            if (e != 0 && e < res) {
+                res = e;
+            }
+        }
+        return res;
+    }
+
+private:
+    static thread_slot &this_thread() {
+        static thread_local thread_slot current;
+        if (current.own == nullptr) {
+            current.own = acquire();
+        }
+        return current;
+    }
+
+    static slot *acquire() {
+        for (auto &s : slots) {
+            bool expected = false;
+            if (!s.taken.load(std::memory_order_relaxed) && s.taken.compare_exchange_strong(expected, true)) {
+                return &s;
+            }
+        }
+        throw std::length_error("reader_epochs: too many reader threads");
+    }
+};
+
+// bimap для многих читателей и редких писателей. Читатели не берут
+// блокировок и не ждут писателей: они читают опубликованную версию
+// persistent_bimap через атомарный указатель. Писатели по очереди меняют
+// под мьютексом свою версию, копируя пути от корня за O(log n), и
+// публикуют ее snapshot() за O(1); неизменившиеся поддеревья версии делят.
+// Снятую с публикации версию удаляет писатель, когда ее не может читать
+// ни один поток, а узлы освобождаются по счетчикам ссылок вместе
+// с последней версией, которая их видит.
+template<typename Left, typename Right, typename CompareLeft = std::less<Left>,
+        typename CompareRight = std::less<Right>>
+struct concurrent_bimap {
+    using left_t = Left;
+    using right_t = Right;
+    using map_type = persistent_bimap<Left, Right, CompareLeft, CompareRight>;
+    using snapshot_type = map_type;
+
+private:
+    std::mutex writer;
+    map_type master;
+    std::atomic<snapshot_type const *> published;
+    // Снятые с публикации снимки и их эпохи.
+    std::vector<std::pair<snapshot_type const *, std::uint64_t>> retired;
+
+public:
+    explicit concurrent_bimap(CompareLeft compare_left = CompareLeft(), CompareRight compare_right = CompareRight())
+            : master(compare_left, compare_right), published(new snapshot_type(master.snapshot())) {}
+
+    concurrent_bimap(concurrent_bimap const &) = delete;
+
+    concurrent_bimap &operator=(concurrent_bimap const &) = delete;
+
+    // Читателей и писателей к этому моменту быть не должно.
+    ~concurrent_bimap() {
+        delete published.load();
+        for (auto const &r : retired) {
+            delete r.first;
+        }
+    }
+
+    // Вызывает f(snapshot_type const &) с текущим снимком. Снимок и его
+    // итераторы живы до выхода из f, изменения, опубликованные за это
+    // время, f не видит. Копия снимка стоит O(1) и остается неизменной
+    // и после выхода из f.
+    template<typename F>
+    decltype(auto) read(F &&f) const {
+        reader_epochs::guard guard;
+        return std::forward<F>(f)(*published.load());
+    }
+
+    // Парный элемент по копии, если элемента нет -- nullopt.
+    template<typename K>
+    std::optional<right_t> find_left(K const &left) const {
+        return read([&](snapshot_type const &s) -> std::optional<right_t> {
+            right_t const *right = s.try_at_left(left);
+            if (right == nullptr) {
+                return std::nullopt;
+            }
+            return *right;
+        });
+    }
+
+    template<typename K>
+    std::optional<left_t> find_right(K const &right) const {
+        return read([&](snapshot_type const &s) -> std::optional<left_t> {
+            left_t const *left = s.try_at_right(right);
+            if (left == nullptr) {
+                return std::nullopt;
+            }
+            return *left;
+        });
+    }
+
+    // Если элемента не существует -- бросает std::out_of_range.
+    template<typename K>
+    right_t at_left(K const &key) const {
+        return read([&](snapshot_type const &s) -> right_t {
+            return s.at_left(key);
+        });
+    }
+
+    template<typename K>
+    left_t at_right(K const &key) const {
+        return read([&](snapshot_type const &s) -> left_t {
+            return s.at_right(key);
+        });
+    }
+
+    [[nodiscard]] size_t size() const {
+        return read([](snapshot_type const &s) {
+            return s.size();
+        });
+    }
+
+    [[nodiscard]] bool empty() const {
+        return size() == 0;
+    }
+
+    // Пакет изменений: f(map_type &) выполняется под мьютексом писателей
+    // над копией master (O(1), версии делят узлы), после чего публикуется
+    // один снимок. Читатели видят либо весь пакет, либо ничего из него.
+    // Если f бросила, копия отбрасывается: master и снимок не меняются.
+    template<typename F>
+    void update(F &&f) {
+        std::lock_guard<std::mutex> lock(writer);
+        map_type batch = master;
+        std::forward<F>(f)(batch);
+        master.swap(batch);
+        publish();
+    }
+
+    // Одиночные изменения -- пакеты из одной операции, O(log n) вместе
+    // с публикацией. Если ничего не изменилось, снимок не публикуется.
+    template<typename L, typename R>
+    bool insert(L &&left, R &&right) {
+        std::lock_guard<std::mutex> lock(writer);
+        if (!master.insert(std::forward<L>(left), std::forward<R>(right))) {
+            return false;
+        }
+        publish();
+        return true;
+    }
+
+    template<typename K>
+    bool erase_left(K const &left) {
+        std::lock_guard<std::mutex> lock(writer);
+        if (!master.erase_left(left)) {
+            return false;
+        }
+        publish();
+        return true;
+    }
+
+    template<typename K>
+    bool erase_right(K const &right) {
+        std::lock_guard<std::mutex> lock(writer);
+        if (!master.erase_right(right)) {
+            return false;
+        }
+        publish();
+        return true;
+    }
+
+private:
+    void publish() {
+        std::unique_ptr<snapshot_type const> fresh(new snapshot_type(master.snapshot()));
+        retired.reserve(retired.size() + 1);
+        snapshot_type const *old = published.exchange(fresh.release());
+        retired.emplace_back(old, reader_epochs::advance());
+        reclaim();
+    }
+
+    void reclaim() noexcept {
+        std::uint64_t oldest = reader_epochs::oldest_reader();
+        auto alive = std::remove_if(retired.begin(), retired.end(), [&](auto const &r) {
+            if (r.second > oldest) {
+                return false;
+            }
+            delete r.first;
+            return true;
+        });
+        retired.erase(alive, retired.end());
+    }
+};
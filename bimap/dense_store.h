@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+// Непрерывное хранилище записей для контейнеров, адресующих их индексами.
+// Не std::vector: перенос последней записи на место удаленной должен
+// работать и без присваивания у ключей.
+template<typename Entry>
+struct dense_store {
+    Entry *data = nullptr;
+    size_t size = 0;
+    size_t capacity = 0;
+
+    dense_store() = default;
+
+    // Делегирует пустому конструктору: если копия записи бросит,
+    // деструктор разрушит уже скопированные записи и освободит буфер.
+    dense_store(dense_store const &other) : dense_store() {
+        reserve(other.size);
+        for (size_t i = 0; i < other.size; i++) {
+            push_back(other.data[i]);
+        }
+    }
+
+    dense_store(dense_store &&other) noexcept
+            : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)),
+              capacity(std::exchange(other.capacity, 0)) {}
+
+    dense_store &operator=(dense_store &&other) noexcept {
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+        std::swap(capacity, other.capacity);
+        return *this;
+    }
+
+    ~dense_store() {
+        clear();
+        std::allocator<Entry>().deallocate(data, capacity);
+    }
+
+    void clear() noexcept {
+        std::destroy(data, data + size);
+        size = 0;
+    }
+
+    void reserve(size_t n) {
+        if (n <= capacity) {
+            return;
+        }
+        Entry *fresh = std::allocator<Entry>().allocate(n);
+        size_t moved = 0;
+        try {
+            for (; moved < size; moved++) {
+                new(fresh + moved) Entry(std::move_if_noexcept(data[moved]));
+            }
+        } catch (...) {
+            std::destroy(fresh, fresh + moved);
+            std::allocator<Entry>().deallocate(fresh, n);
+            throw;
+        }
+        std::destroy(data, data + size);
+        std::allocator<Entry>().deallocate(data, capacity);
+        data = fresh;
+        capacity = n;
+    }
+
+    template<typename... Args>
+    void push_back(Args &&... args) {
+        if (size == capacity) {
+            reserve(capacity == 0 ? 8 : capacity * 2);
+        }
+        new(data + size) Entry{std::forward<Args>(args)...};
+        size++;
+    }
+
+    // Удаляет запись i, перенося на ее место последнюю.
+    void remove(size_t i) {
+        std::destroy_at(data + i);
+        size--;
+        if (i != size) {
+            new(data + i) Entry(std::move(data[size]));
+            std::destroy_at(data + size);
+        }
+    }
+};
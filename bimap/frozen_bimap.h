@@ -0,0 +1,429 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Элементы обеих сторон упорядоченного bimap-подобного контейнера по рангам
+// и ранги партнеров. От контейнера нужны left_t, right_t, size(), обходы
+// обеих сторон по порядку и flip().
+template<typename Source>
+struct bimap_ranks {
+    using left_t = typename Source::left_t;
+    using right_t = typename Source::right_t;
+
+    std::vector<left_t const *> lefts;
+    std::vector<right_t const *> rights;
+    std::vector<size_t> right_rank_of_left;
+    std::vector<size_t> left_rank_of_right;
+
+    explicit bimap_ranks(Source const &source) {
+        size_t n = source.size();
+        lefts.reserve(n);
+        rights.reserve(n);
+        for (auto it = source.begin_left(); it != source.end_left(); ++it) {
+            lefts.push_back(&*it);
+        }
+        // Ранг left по адресу: партнер right известен только адресом.
+        std::vector<std::pair<left_t const *, size_t>> by_address;
+        by_address.reserve(n);
+        for (size_t r = 0; r < n; r++) {
+            by_address.emplace_back(lefts[r], r);
+        }
+        std::sort(by_address.begin(), by_address.end(), [](auto const &a, auto const &b) {
+            return std::less<left_t const *>()(a.first, b.first);
+        });
+        right_rank_of_left.resize(n);
+        left_rank_of_right.resize(n);
+        for (auto it = source.begin_right(); it != source.end_right(); ++it) {
+            left_t const *partner = &*it.flip();
+            auto pos = std::lower_bound(by_address.begin(), by_address.end(), partner,
+                                        [](auto const &a, left_t const *b) {
+                                            return std::less<left_t const *>()(a.first, b);
+                                        });
+            right_rank_of_left[pos->second] = rights.size();
+            left_rank_of_right[rights.size()] = pos->second;
+            rights.push_back(&*it);
+        }
+    }
+};
+
+// Неизменяемый снимок bimap, см. bimap::freeze().
+// Каждая сторона хранится одним массивом в порядке Eytzinger (обход дерева
+// поиска в ширину): корень в слоте 1, дети слота k -- в слотах 2k и 2k + 1.
+// Первые уровни дерева лежат рядом и остаются в кеше, а поиск -- это цикл
+// k = 2k + (a[k] < x) без ветвлений с предвыборкой на несколько уровней
+// вперед. Ключи и ссылки на партнеров лежат в разных массивах, поэтому
+// поиск читает только ключи.
+template<typename Left, typename Right, typename CompareLeft = std::less<Left>,
+        typename CompareRight = std::less<Right>>
+struct frozen_bimap {
+
+    using left_t = Left;
+    using right_t = Right;
+
+    struct tag_key {
+    };
+    struct tag_value {
+    };
+
+private:
+    // Слоты нумеруются с единицы, 0 -- end(). В массивах слот k лежит по индексу k - 1.
+    template<typename T, typename Compare>
+    struct side_array : Compare {
+        std::vector<T> keys;
+        std::vector<size_t> partner;
+
+        explicit side_array(const Compare &cmp) : Compare(cmp) {}
+
+        bool less(const T &a, const T &b) const {
+            return static_cast<const Compare &>(*this)(a, b);
+        }
+
+        size_t size() const noexcept {
+            return keys.size();
+        }
+
+        T const &at(size_t k) const noexcept {
+            return keys[k - 1];
+        }
+
+        // Самый левый слот поддерева k.
+        size_t leftmost(size_t k) const noexcept {
+            while (2 * k <= size()) {
+                k = 2 * k;
+            }
+            return k;
+        }
+
+        size_t rightmost(size_t k) const noexcept {
+            while (2 * k + 1 <= size()) {
+                k = 2 * k + 1;
+            }
+            return k;
+        }
+
+        // Следующий по порядку слот: самый левый в правом поддереве или
+        // первый предок, для которого мы в левом поддереве. За последним -- 0.
+        size_t next(size_t k) const noexcept {
+            if (2 * k + 1 <= size()) {
+                return leftmost(2 * k + 1);
+            }
+            while (k & 1) {
+                k >>= 1;
+            }
+            return k >> 1;
+        }
+
+        size_t prev(size_t k) const noexcept {
+            if (k == 0) {
+                return size() == 0 ? 0 : rightmost(1);
+            }
+            if (2 * k <= size()) {
+                return rightmost(2 * k);
+            }
+            while (k != 0 && !(k & 1)) {
+                k >>= 1;
+            }
+            return k >> 1;
+        }
+
+        // Спуск всегда проходит полную высоту дерева. Путь кодируется в битах k:
+        // 1 -- шаг вправо. Ответ -- последний слот, из которого шагнули влево,
+        // то есть k без хвоста из единиц и еще одного бита.
+        template<typename Less>
+        size_t descend(Less go_right) const noexcept {
+            // Слоты 16k..16k+15 -- правнуки k через четыре уровня, для int это одна кеш-линия.
+            constexpr size_t prefetch_distance = 16;
+            size_t n = size();
+            const T *data = keys.data();
+            size_t k = 1;
+            while (k <= n) {
+#if defined(__GNUC__)
+                if (prefetch_distance * k <= n) {
+                    __builtin_prefetch(data + prefetch_distance * k - 1);
+                }
+#endif
+                k = 2 * k + static_cast<size_t>(go_right(data[k - 1]));
+            }
+            return k >> (trailing_ones(k) + 1);
+        }
+
+        size_t lower_bound(const T &val) const {
+            return descend([&](const T &key) { return less(key, val); });
+        }
+
+        size_t upper_bound(const T &val) const {
+            return descend([&](const T &key) { return !less(val, key); });
+        }
+
+        size_t find(const T &val) const {
+            size_t k = lower_bound(val);
+            return k != 0 && !less(val, at(k)) ? k : 0;
+        }
+
+        static int trailing_ones(size_t k) noexcept {
+#if defined(__GNUC__)
+            return __builtin_ctzll(~static_cast<unsigned long long>(k));
+#else
+            int res = 0;
+            for (; k & 1; k >>= 1) {
+                res++;
+            }
+            return res;
+#endif
+        }
+
+        // Слот для каждого ранга: обходим неявное дерево по порядку.
+        static std::vector<size_t> slots_by_rank(size_t n) {
+            std::vector<size_t> res;
+            res.reserve(n);
+            if (n == 0) {
+                return res;
+            }
+            size_t k = 1;
+            while (2 * k <= n) {
+                k = 2 * k;
+            }
+            for (size_t i = 0; i < n; i++) {
+                res.push_back(k);
+                if (2 * k + 1 <= n) {
+                    k = 2 * k + 1;
+                    while (2 * k <= n) {
+                        k = 2 * k;
+                    }
+                } else {
+                    while (k & 1) {
+                        k >>= 1;
+                    }
+                    k >>= 1;
+                }
+            }
+            return res;
+        }
+
+        // Раскладывает ключи, переданные по рангам, по слотам.
+        void fill(std::vector<T const *> const &by_rank, std::vector<size_t> const &slot_of_rank) {
+            size_t n = by_rank.size();
+            std::vector<size_t> rank_of_slot(n + 1);
+            for (size_t r = 0; r < n; r++) {
+                rank_of_slot[slot_of_rank[r]] = r;
+            }
+            keys.reserve(n);
+            for (size_t k = 1; k <= n; k++) {
+                keys.push_back(*by_rank[rank_of_slot[k]]);
+            }
+        }
+    };
+
+    side_array<Left, CompareLeft> left_side;
+    side_array<Right, CompareRight> right_side;
+
+public:
+    template<typename side>
+    struct iterator {
+        using type = typename std::conditional<std::is_same_v<side, tag_key>, left_t, right_t>::type;
+        using inv_side = typename std::conditional<std::is_same_v<side, tag_key>, tag_value, tag_key>::type;
+
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = type const *;
+        using reference = type const &;
+
+        const frozen_bimap *owner;
+        size_t slot;
+
+        iterator(const frozen_bimap *owner, size_t slot) noexcept: owner(owner), slot(slot) {}
+
+        type const &operator*() const noexcept {
+            return array().at(slot);
+        }
+
+        type const *operator->() const noexcept {
+            return &**this;
+        }
+
+        iterator &operator++() noexcept {
+            slot = array().next(slot);
+            return *this;
+        }
+
+        iterator operator++(int) noexcept {
+            iterator prev = *this;
+            ++*this;
+            return prev;
+        }
+
+        iterator &operator--() noexcept {
+            slot = array().prev(slot);
+            return *this;
+        }
+
+        iterator operator--(int) noexcept {
+            iterator prev = *this;
+            --*this;
+            return prev;
+        }
+
+        friend bool operator==(iterator first, iterator second) noexcept {
+            return first.slot == second.slot;
+        }
+
+        friend bool operator!=(iterator first, iterator second) noexcept {
+            return first.slot != second.slot;
+        }
+
+        iterator<inv_side> flip() const noexcept {
+            return iterator<inv_side>(owner, array().partner[slot - 1]);
+        }
+
+    private:
+        auto const &array() const noexcept {
+            if constexpr (std::is_same_v<side, tag_key>) {
+                return owner->left_side;
+            } else {
+                return owner->right_side;
+            }
+        }
+    };
+
+    using left_iterator = iterator<tag_key>;
+    using right_iterator = iterator<tag_value>;
+
+    explicit frozen_bimap(CompareLeft compare_left = CompareLeft(), CompareRight compare_right = CompareRight())
+            : left_side(compare_left), right_side(compare_right) {}
+
+    // Снимок любого упорядоченного bimap-подобного контейнера, см. bimap_ranks.
+    // Строится за O(n log n).
+    template<typename Source>
+    explicit frozen_bimap(Source const &source, CompareLeft compare_left = CompareLeft(),
+                          CompareRight compare_right = CompareRight())
+            : left_side(compare_left), right_side(compare_right) {
+        bimap_ranks<Source> ranks(source);
+        size_t n = ranks.lefts.size();
+        auto slot_of_rank = side_array<Left, CompareLeft>::slots_by_rank(n);
+        left_side.fill(ranks.lefts, slot_of_rank);
+        right_side.fill(ranks.rights, slot_of_rank);
+        // Форма дерева зависит только от n, поэтому слоты рангов у сторон общие.
+        left_side.partner.resize(n);
+        right_side.partner.resize(n);
+        for (size_t r = 0; r < n; r++) {
+            left_side.partner[slot_of_rank[r] - 1] = slot_of_rank[ranks.right_rank_of_left[r]];
+            right_side.partner[slot_of_rank[r] - 1] = slot_of_rank[ranks.left_rank_of_right[r]];
+        }
+    }
+
+    left_iterator find_left(left_t const &left) const {
+        return left_iterator(this, left_side.find(left));
+    }
+
+    right_iterator find_right(right_t const &right) const {
+        return right_iterator(this, right_side.find(right));
+    }
+
+    // Если элемента не существует -- бросает std::out_of_range.
+    right_t const &at_left(left_t const &key) const {
+        size_t k = left_side.find(key);
+        if (k == 0) {
+            throw std::out_of_range("frozen_bimap::at_left");
+        }
+        return right_side.at(left_side.partner[k - 1]);
+    }
+
+    left_t const &at_right(right_t const &key) const {
+        size_t k = right_side.find(key);
+        if (k == 0) {
+            throw std::out_of_range("frozen_bimap::at_right");
+        }
+        return left_side.at(right_side.partner[k - 1]);
+    }
+
+    left_iterator lower_bound_left(const left_t &left) const {
+        return left_iterator(this, left_side.lower_bound(left));
+    }
+
+    left_iterator upper_bound_left(const left_t &left) const {
+        return left_iterator(this, left_side.upper_bound(left));
+    }
+
+    right_iterator lower_bound_right(const right_t &right) const {
+        return right_iterator(this, right_side.lower_bound(right));
+    }
+
+    right_iterator upper_bound_right(const right_t &right) const {
+        return right_iterator(this, right_side.upper_bound(right));
+    }
+
+    std::pair<left_iterator, left_iterator> equal_range_left(const left_t &left) const {
+        left_iterator first = lower_bound_left(left);
+        left_iterator last = first;
+        if (first != end_left() && !left_side.less(left, *first)) {
+            ++last;
+        }
+        return {first, last};
+    }
+
+    std::pair<right_iterator, right_iterator> equal_range_right(const right_t &right) const {
+        right_iterator first = lower_bound_right(right);
+        right_iterator last = first;
+        if (first != end_right() && !right_side.less(right, *first)) {
+            ++last;
+        }
+        return {first, last};
+    }
+
+    left_iterator begin_left() const noexcept {
+        return left_iterator(this, empty() ? 0 : left_side.leftmost(1));
+    }
+
+    left_iterator end_left() const noexcept {
+        return left_iterator(this, 0);
+    }
+
+    right_iterator begin_right() const noexcept {
+        return right_iterator(this, empty() ? 0 : right_side.leftmost(1));
+    }
+
+    right_iterator end_right() const noexcept {
+        return right_iterator(this, 0);
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return left_side.size() == 0;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return left_side.size();
+    }
+};
+
+template<typename Left, typename Right, typename CompareLeft, typename CompareRight>
+bool operator==(frozen_bimap<Left, Right, CompareLeft, CompareRight> const &a,
+                frozen_bimap<Left, Right, CompareLeft, CompareRight> const &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    auto it_a = a.begin_left();
+    auto it_b = b.begin_left();
+    while (it_a != a.end_left()) {
+        if (*it_a != *it_b || *(it_a.flip()) != *(it_b.flip())) {
+            return false;
+        }
+        ++it_a;
+        ++it_b;
+    }
+    return true;
+}
+
+template<typename Left, typename Right, typename CompareLeft, typename CompareRight>
+bool operator!=(frozen_bimap<Left, Right, CompareLeft, CompareRight> const &a,
+                frozen_bimap<Left, Right, CompareLeft, CompareRight> const &b) {
+    return !(a == b);
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "../signal/intrusive_list.h"
+#include "bimap.h"
+
+struct lru_bimap_tag;
+
+// Узлы bimap с этой политикой -- еще и элементы списка давности обращений.
+struct lru_bimap_policy : bimap_default_policy {
+    using node_hook = intrusive::list_element<lru_bimap_tag>;
+};
+
+// Двусторонний кеш ограниченной емкости. Каждый узел пары висит в
+// интрузивном списке от давно использованных к свежим: find_*/at_*
+// переносят пару в конец списка за O(1), вставка сверх емкости удаляет
+// из обоих treap'ов голову списка. Узел вытесненной пары остается в пуле
+// bimap и достается следующей вставке, так что заполненный кеш к
+// аллокатору не обращается. Обход begin/end идет по ключам и давность
+// не меняет.
+template<typename Left, typename Right, typename CompareLeft = std::less<Left>,
+        typename CompareRight = std::less<Right>, typename Allocator = std::allocator<std::pair<Left, Right>>>
+struct lru_bimap {
+    using map_type = bimap<Left, Right, CompareLeft, CompareRight, Allocator, lru_bimap_policy>;
+
+    using left_t = Left;
+    using right_t = Right;
+    using left_iterator = typename map_type::left_iterator;
+    using right_iterator = typename map_type::right_iterator;
+
+private:
+    using node_heavy = typename map_type::node_heavy;
+
+    map_type map;
+    // От давно использованных к свежим.
+    intrusive::list<node_heavy, lru_bimap_tag> recency;
+    size_t max_size;
+
+public:
+    explicit lru_bimap(size_t capacity, CompareLeft compare_left = CompareLeft(),
+                       CompareRight compare_right = CompareRight(), const Allocator &alloc = Allocator())
+            : map(std::move(compare_left), std::move(compare_right), alloc), max_size(capacity) {}
+
+    // Копия сохраняет порядок давности, узлы копии находятся по ключам.
+    lru_bimap(lru_bimap const &other) : map(other.map), max_size(other.max_size) {
+        relink(other);
+    }
+
+    lru_bimap(lru_bimap &&other) noexcept = default;
+
+    lru_bimap &operator=(lru_bimap const &other) {
+        if (this != &other) {
+            map = other.map;
+            max_size = other.max_size;
+            relink(other);
+        }
+        return *this;
+    }
+
+    // Если bimap забрал узлы other, список давности просто переезжает,
+    // иначе (неравные аллокаторы) пары скопированы и связываются заново.
+    lru_bimap &operator=(lru_bimap &&other) {
+        if (this == &other) {
+            return *this;
+        }
+        map = std::move(other.map);
+        max_size = other.max_size;
+        if (!other.recency.empty() && node_of(map.find_left(left_key(other.recency.front()))) ==
+                                      &other.recency.front()) {
+            recency = std::move(other.recency);
+        } else {
+            relink(other);
+        }
+        return *this;
+    }
+
+    // Вставка пары как в bimap::insert, новая пара -- самая свежая.
+    // Если пар стало больше емкости, вытесняется самая давняя.
+    // Если left или right уже есть, ничего не меняется и возвращается end_left().
+    template<typename L, typename R>
+    left_iterator insert(L &&left, R &&right) {
+        auto it = map.emplace(std::forward<L>(left), std::forward<R>(right));
+        if (it == map.end_left()) {
+            return it;
+        }
+        node_heavy *node = node_of(it);
+        recency.push_back(*node);
+        if (map.size() > max_size) {
+            node_heavy *victim = &recency.front();
+            map.erase_left(left_iterator(victim));
+            if (victim == node) {
+                return map.end_left();
+            }
+        }
+        return it;
+    }
+
+    // Поиск как в bimap, найденная пара становится самой свежей.
+    template<typename K>
+    left_iterator find_left(K const &left) {
+        auto it = map.find_left(left);
+        if (it != map.end_left()) {
+            touch(node_of(it));
+        }
+        return it;
+    }
+
+    template<typename K>
+    right_iterator find_right(K const &right) {
+        auto it = map.find_right(right);
+        if (it != map.end_right()) {
+            touch(node_of(it.flip()));
+        }
+        return it;
+    }
+
+    // Если элемента не существует -- бросает std::out_of_range.
+    template<typename K>
+    right_t const &at_left(K const &key) {
+        auto it = find_left(key);
+        if (it == map.end_left()) {
+            throw std::out_of_range("lru_bimap::at_left");
+        }
+        return *it.flip();
+    }
+
+    template<typename K>
+    left_t const &at_right(K const &key) {
+        auto it = find_right(key);
+        if (it == map.end_right()) {
+            throw std::out_of_range("lru_bimap::at_right");
+        }
+        return *it.flip();
+    }
+
+    // Удаленный узел сам выходит из списка давности.
+    left_iterator erase_left(left_iterator it) {
+        return map.erase_left(it);
+    }
+
+    right_iterator erase_right(right_iterator it) {
+        return map.erase_right(it);
+    }
+
+    template<typename K>
+    bool erase_left(K const &left) {
+        return map.erase_left(left);
+    }
+
+    template<typename K>
+    bool erase_right(K const &right) {
+        return map.erase_right(right);
+    }
+
+    void clear() noexcept {
+        map.clear();
+    }
+
+    left_iterator begin_left() const noexcept {
+        return map.begin_left();
+    }
+
+    left_iterator end_left() const noexcept {
+        return map.end_left();
+    }
+
+    right_iterator begin_right() const noexcept {
+        return map.begin_right();
+    }
+
+    right_iterator end_right() const noexcept {
+        return map.end_right();
+    }
+
+    // Самая давняя пара, ее вытеснит следующая вставка в полный кеш.
+    // Для пустого кеша -- end_left().
+    left_iterator least_recent() const noexcept {
+        return recency.empty() ? map.end_left() : left_iterator(const_cast<node_heavy *>(&recency.front()));
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return map.empty();
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return map.size();
+    }
+
+    [[nodiscard]] size_t capacity() const noexcept {
+        return max_size;
+    }
+
+private:
+    static node_heavy *node_of(left_iterator it) noexcept {
+        return static_cast<node_heavy *>(it.cur_node);
+    }
+
+    static left_t const &left_key(node_heavy const &node) noexcept {
+        return *left_iterator(const_cast<node_heavy *>(&node));
+    }
+
+    void touch(node_heavy *node) noexcept {
+        static_cast<intrusive::list_element<lru_bimap_tag> &>(*node).unlink();
+        recency.push_back(*node);
+    }
+
+    void relink(lru_bimap const &other) {
+        recency.clear();
+        for (auto const &node : other.recency) {
+            recency.push_back(*node_of(map.find_left(left_key(node))));
+        }
+    }
+};
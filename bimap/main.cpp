@@ -1,6 +1,19 @@
 #include "bimap.h"
+#include "compact_bimap.h"
+#include "concurrent_bimap.h"
+#include "lru_bimap.h"
+#include "mapped_bimap.h"
+#include "persistent_bimap.h"
+#include "sharded_bimap.h"
+#include "unordered_bimap.h"
 #include "gtest/gtest.h"
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <memory_resource>
 #include <random>
+#include <set>
+#include <thread>
 
 struct test_object {
   int a = 0;
@@ -89,6 +102,55 @@ TEST(bimap, custom_parametrized_comparator) {
   }
 }
 
+struct test_object_compare {
+  using is_transparent = void;
+  bool operator()(test_object const &a, test_object const &b) const { return a.a < b.a; }
+  bool operator()(test_object const &a, int b) const { return a.a < b; }
+  bool operator()(int a, test_object const &b) const { return a < b.a; }
+};
+
+TEST(bimap, transparent_lookup) {
+  // test_object не строится из int неявно: поиск идет без временного ключа.
+  bimap<test_object, int, test_object_compare> b;
+  b.insert(test_object(1), 10);
+  b.insert(test_object(3), 30);
+  b.insert(test_object(5), 50);
+  EXPECT_EQ(*b.find_left(3).flip(), 30);
+  EXPECT_EQ(b.find_left(4), b.end_left());
+  EXPECT_EQ(b.at_left(5), 50);
+  EXPECT_EQ((*b.lower_bound_left(2)).a, 3);
+  EXPECT_EQ((*b.upper_bound_left(3)).a, 5);
+  auto range = b.equal_range_left(1);
+  EXPECT_EQ(std::distance(range.first, range.second), 1);
+  EXPECT_THROW(b.at_left(2), std::out_of_range);
+  EXPECT_TRUE(b.erase_left(1));
+  EXPECT_FALSE(b.erase_left(1));
+  EXPECT_EQ(b.extract_left(3).right(), 30);
+  EXPECT_EQ(b.size(), 1);
+
+  bimap<std::string, std::string, std::less<>, std::less<>> names;
+  names.insert("one", "1");
+  EXPECT_EQ(names.at_right(std::string_view("1")), "one");
+  EXPECT_EQ(*names.find_left("one").flip(), "1");
+}
+
+struct case_insensitive_compare {
+  bool operator()(std::string const &a, std::string const &b) const {
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+                                        [](char x, char y) { return std::tolower(x) < std::tolower(y); });
+  }
+};
+
+TEST(bimap, equivalence_not_equality) {
+  bimap<std::string, int, case_insensitive_compare> b;
+  b.insert("Key", 1);
+  EXPECT_EQ(b.insert("KEY", 2), b.end_left());
+  EXPECT_EQ(*b.find_left("key"), "Key");
+  EXPECT_EQ(b.at_left("kEy"), 1);
+  EXPECT_TRUE(b.erase_left("KEY"));
+  EXPECT_TRUE(b.empty());
+}
+
 TEST(bimap, copies) {
   bimap<int, int> b;
   b.insert(3, 4);
@@ -272,6 +334,622 @@ TEST(bimap, upper_bound) {
   EXPECT_EQ(b.upper_bound_left(400), b.end_left());
 }
 
+TEST(bimap, equal_range) {
+  bimap<int, int> b;
+  b.insert(1, 20);
+  b.insert(3, 10);
+  b.insert(5, 30);
+
+  auto l = b.equal_range_left(3);
+  EXPECT_EQ(*l.first, 3);
+  EXPECT_EQ(*l.second, 5);
+  auto r = b.equal_range_right(15);
+  EXPECT_EQ(r.first, r.second);
+  EXPECT_EQ(*r.first, 20);
+  auto e = b.equal_range_left(6);
+  EXPECT_EQ(e.first, b.end_left());
+  EXPECT_EQ(e.second, b.end_left());
+}
+
+TEST(bimap, construct_sorted) {
+  std::vector<std::pair<int, int>> data = {
+      {1, 5}, {2, 3}, {2, 7}, {4, 3}, {6, 1}, {8, 9}};
+  bimap<int, int> b(data.begin(), data.end());
+  EXPECT_EQ(b.size(), 4);
+  EXPECT_EQ(b.at_left(1), 5);
+  EXPECT_EQ(b.at_left(2), 3);
+  EXPECT_EQ(b.find_left(4), b.end_left());
+  EXPECT_EQ(b.at_right(1), 6);
+
+  bimap<int, int> expected;
+  expected.insert(1, 5);
+  expected.insert(2, 3);
+  expected.insert(6, 1);
+  expected.insert(8, 9);
+  EXPECT_EQ(b, expected);
+}
+
+TEST(bimap, assign_sorted_unsorted_input) {
+  bimap<int, int> b;
+  b.insert(100, 100);
+  std::vector<std::pair<int, int>> data = {{5, 1}, {3, 2}, {5, 3}, {1, 4}};
+  b.assign_sorted(data.begin(), data.end());
+  EXPECT_EQ(b.size(), 3);
+  EXPECT_EQ(b.find_left(100), b.end_left());
+  std::vector<int> lefts;
+  for (auto it = b.begin_left(); it != b.end_left(); it++) {
+    lefts.push_back(*it);
+  }
+  EXPECT_EQ(lefts, (std::vector<int>{1, 3, 5}));
+  EXPECT_EQ(b.at_left(5), 1);
+}
+
+struct counting_resource : std::pmr::memory_resource {
+  size_t allocations = 0;
+  size_t deallocations = 0;
+
+private:
+  void *do_allocate(size_t bytes, size_t align) override {
+    allocations++;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+  void do_deallocate(void *p, size_t bytes, size_t align) override {
+    deallocations++;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+  bool do_is_equal(memory_resource const &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+using pmr_bimap = bimap<int, int, std::less<int>, std::less<int>,
+                        std::pmr::polymorphic_allocator<std::pair<int, int>>>;
+
+TEST(bimap, pmr_allocator) {
+  counting_resource resource;
+  {
+    pmr_bimap b(&resource);
+    EXPECT_EQ(resource.allocations, 0);
+    for (int i = 0; i < 1000; i++) {
+      b.insert(i, -i);
+    }
+    EXPECT_GT(resource.allocations, 0);
+    EXPECT_LT(resource.allocations, 100);
+    EXPECT_EQ(b.at_left(500), -500);
+    EXPECT_EQ(b.get_allocator().resource(), &resource);
+
+    pmr_bimap moved(std::move(b));
+    EXPECT_EQ(moved.size(), 1000);
+    EXPECT_EQ(moved.at_right(-999), 999);
+  }
+  EXPECT_EQ(resource.allocations, resource.deallocations);
+}
+
+TEST(bimap, reserve) {
+  counting_resource resource;
+  pmr_bimap b(&resource);
+  b.reserve(500);
+  size_t after_reserve = resource.allocations;
+  EXPECT_EQ(after_reserve, 1);
+  for (int i = 0; i < 500; i++) {
+    b.insert(i, i);
+  }
+  for (int i = 0; i < 500; i += 2) {
+    b.erase_left(i);
+  }
+  for (int i = 1000; i < 1250; i++) {
+    b.insert(i, i);
+  }
+  EXPECT_EQ(resource.allocations, after_reserve);
+  EXPECT_EQ(b.size(), 500);
+}
+
+using ranked_bimap = bimap<int, int, std::less<int>, std::less<int>,
+                           std::allocator<std::pair<int, int>>,
+                           bimap_order_statistics_policy>;
+
+TEST(bimap, order_statistics) {
+  ranked_bimap b;
+  for (int i = 0; i < 10; i++) {
+    b.insert(i * 10, 100 - i);
+  }
+  EXPECT_EQ(*b.nth_left(0), 0);
+  EXPECT_EQ(*b.nth_left(3), 30);
+  EXPECT_EQ(*b.nth_right(0), 91);
+  EXPECT_EQ(*b.nth_right(9).flip(), 0);
+  EXPECT_EQ(b.nth_left(10), b.end_left());
+  EXPECT_EQ(b.rank_left(35), 4);
+  EXPECT_EQ(b.rank_left(-1), 0);
+  EXPECT_EQ(b.rank_right(95), 4);
+  EXPECT_EQ(b.rank_right(1000), 10);
+
+  b.erase_left(30);
+  EXPECT_EQ(*b.nth_left(3), 40);
+  EXPECT_EQ(b.rank_right(97), 6);
+}
+
+TEST(bimap, erase_keeps_order_statistics) {
+  ranked_bimap b;
+  for (int i = 0; i < 100; i++) {
+    b.insert(i, (i * 37) % 100);
+  }
+  auto next = b.erase_right(b.find_right(0));
+  EXPECT_EQ(*next, 1);
+  EXPECT_EQ(b.find_left(0), b.end_left());
+  b.erase_left(b.nth_left(10), b.nth_left(20));
+  b.erase_left(50);
+  EXPECT_EQ(b.size(), 88);
+  auto it = b.begin_left();
+  for (size_t k = 0; k < b.size(); k++, it++) {
+    EXPECT_EQ(b.rank_left(*it), k);
+    EXPECT_EQ(b.nth_right(b.rank_right(*it.flip())).flip(), it);
+  }
+}
+
+TEST(bimap, iterator_distance_advance) {
+  ranked_bimap b;
+  for (int i = 0; i < 100; i++) {
+    b.insert(i, -i);
+  }
+  auto it = b.begin_left();
+  advance(it, 42);
+  EXPECT_EQ(*it, 42);
+  advance(it, -40);
+  EXPECT_EQ(*it, 2);
+  EXPECT_EQ(distance(it, b.end_left()), 98);
+  EXPECT_EQ(distance(b.end_left(), it), -98);
+  auto r = b.end_right();
+  advance(r, -1);
+  EXPECT_EQ(*r, 0);
+  EXPECT_EQ(distance(b.begin_right(), r), 99);
+  EXPECT_EQ(std::distance(b.begin_right(), r), 99);
+
+  bimap<int, int> plain;
+  plain.insert(1, 1);
+  plain.insert(2, 2);
+  EXPECT_EQ(distance(plain.begin_left(), plain.end_left()), 2);
+}
+
+TEST(bimap, copy_keeps_shape_and_order_statistics) {
+  ranked_bimap b;
+  for (int i = 0; i < 500; i++) {
+    b.insert(i * 7 % 500, i);
+  }
+  ranked_bimap copy(b);
+  EXPECT_EQ(copy, b);
+  for (size_t k = 0; k < 500; k += 17) {
+    EXPECT_EQ(*copy.nth_right(k), *b.nth_right(k));
+    EXPECT_EQ(copy.rank_left(k), k);
+  }
+  copy.erase_left(3);
+  EXPECT_EQ(b.size(), 500);
+  EXPECT_EQ(copy.size(), 499);
+  EXPECT_NE(copy, b);
+}
+
+TEST(bimap, copy_assign_keeps_comparators) {
+  using vec = std::pair<int, int>;
+  using vec_bimap = bimap<vec, int, vector_compare>;
+  vec_bimap b(vector_compare(vector_compare::manhattan));
+  b.insert({3, -3}, 1);
+  b.insert({0, 4}, 2);
+  vec_bimap copy;
+  copy.insert({1, 1}, 3);
+  copy = b;
+  // По Манхэттену (3, -3) не ближе (0, 6), по Евклиду -- ближе.
+  EXPECT_EQ(*copy.lower_bound_left({0, 6}).flip(), 1);
+
+  vec_bimap moved;
+  moved = std::move(copy);
+  EXPECT_EQ(*moved.lower_bound_left({0, 6}).flip(), 1);
+}
+
+TEST(bimap, clear) {
+  counting_resource resource;
+  pmr_bimap b(&resource);
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i, -i);
+  }
+  size_t allocations = resource.allocations;
+  b.clear();
+  EXPECT_TRUE(b.empty());
+  EXPECT_EQ(b.begin_left(), b.end_left());
+  EXPECT_EQ(b.find_right(-5), b.end_right());
+  for (int i = 0; i < 1000; i++) {
+    b.insert(-i, i);
+  }
+  EXPECT_EQ(resource.allocations, allocations);
+  EXPECT_EQ(b.at_left(-999), 999);
+}
+
+TEST(bimap, move_assign) {
+  counting_resource resource, other_resource;
+  pmr_bimap a(&resource), b(&resource), c(&other_resource);
+  for (int i = 0; i < 100; i++) {
+    a.insert(i, i);
+    b.insert(-i, -i);
+    c.insert(i * 2, i);
+  }
+  size_t allocations = resource.allocations;
+  a = std::move(b);
+  EXPECT_EQ(resource.allocations, allocations);
+  EXPECT_EQ(a.at_left(-99), -99);
+  EXPECT_EQ(a.find_left(99), a.end_left());
+
+  a = std::move(c);
+  EXPECT_EQ(a.size(), 100);
+  EXPECT_EQ(a.at_left(198), 99);
+  EXPECT_EQ(a.get_allocator().resource(), &resource);
+}
+
+TEST(bimap, emplace) {
+  bimap<std::string, std::string> b;
+  EXPECT_EQ(*b.emplace("one", "1"), "one");
+  EXPECT_EQ(b.emplace("one", "2"), b.end_left());
+  EXPECT_EQ(b.at_right("1"), "one");
+
+  bimap<test_object, test_object> moves;
+  moves.emplace(test_object(1), test_object(2));
+  test_object x(1), y(7);
+  EXPECT_EQ(moves.emplace(std::move(x), std::move(y)), moves.end_left());
+  EXPECT_EQ(x.a, 1);
+  EXPECT_EQ(y.a, 7);
+}
+
+TEST(bimap, insert_hint) {
+  ranked_bimap b;
+  for (int i = 0; i < 100; i++) {
+    b.insert(b.end_left(), b.end_right(), i, -i);
+  }
+  for (int i = -1; i > -100; i--) {
+    b.insert(b.begin_left(), b.end_right(), i, 1000 - i);
+  }
+  EXPECT_EQ(b.size(), 199);
+  EXPECT_EQ(*b.nth_left(0), -99);
+  EXPECT_EQ(*b.nth_right(0), -99);
+  EXPECT_EQ(b.rank_right(1001), 100);
+
+  // Неверные подсказки и дубликаты рядом с подсказкой.
+  EXPECT_EQ(*b.insert(b.begin_left(), b.begin_right(), 500, 500), 500);
+  EXPECT_EQ(b.insert(b.find_left(50), b.end_right(), 49, 5000), b.end_left());
+  EXPECT_EQ(b.insert(b.end_left(), b.find_right(-49), 600, -50), b.end_left());
+  EXPECT_EQ(b.size(), 200);
+  int previous = *b.begin_left();
+  for (auto it = ++b.begin_left(); it != b.end_left(); it++) {
+    EXPECT_GT(*it, previous);
+    previous = *it;
+  }
+}
+
+TEST(bimap, node_handle) {
+  counting_resource resource;
+  pmr_bimap a(&resource), b(&resource);
+  for (int i = 0; i < 100; i++) {
+    a.insert(i, -i);
+  }
+  // Узел переходит в b через его пул, слот остается в пуле a.
+  size_t allocations = resource.allocations;
+  for (int i = 0; i < 100; i += 2) {
+    auto nh = a.extract_left(i);
+    ASSERT_FALSE(nh.empty());
+    EXPECT_TRUE(b.insert(std::move(nh)).inserted);
+  }
+  EXPECT_EQ(a.size(), 50);
+  EXPECT_EQ(b.size(), 50);
+  EXPECT_EQ(b.at_left(98), -98);
+  EXPECT_EQ(a.find_left(98), a.end_left());
+  EXPECT_TRUE(a.extract_left(98).empty());
+
+  // Перестановка ключа внутри a: узел не покидает свой слот.
+  allocations = resource.allocations;
+  size_t deallocations = resource.deallocations;
+  for (int i = 1; i < 100; i += 2) {
+    auto nh = a.extract_right(-i);
+    nh.left() = 1000 + i;
+    EXPECT_EQ(*a.insert(std::move(nh)).position, 1000 + i);
+  }
+  EXPECT_EQ(a.at_right(-1), 1001);
+  EXPECT_EQ(a.size(), 50);
+  EXPECT_EQ(resource.allocations, allocations);
+  EXPECT_EQ(resource.deallocations, deallocations);
+
+  auto conflict = b.extract_left(b.find_left(0));
+  conflict.right() = -3;
+  auto res = a.insert(std::move(conflict));
+  EXPECT_FALSE(res.inserted);
+  EXPECT_EQ(res.position, a.end_left());
+  EXPECT_EQ(res.node.left(), 0);
+  EXPECT_TRUE(b.insert(std::move(res.node)).inserted);
+  EXPECT_EQ(b.at_left(0), -3);
+}
+
+TEST(bimap, node_handle_outlives_source) {
+  using string_bimap = bimap<std::string, std::string>;
+  string_bimap::node_type orphan;
+  string_bimap::node_type nh;
+  {
+    string_bimap a;
+    for (int i = 0; i < 20; i++) {
+      a.insert("left " + std::to_string(i), "right " + std::to_string(i));
+    }
+    nh = a.extract_left("left 3");
+    orphan = a.extract_right("right 7");
+    string_bimap moved = std::move(a);
+    a = moved;
+    moved = string_bimap();
+  }
+  EXPECT_EQ(nh.left(), "left 3");
+  EXPECT_EQ(orphan.right(), "right 7");
+  {
+    string_bimap b;
+    EXPECT_TRUE(b.insert(std::move(nh)).inserted);
+    EXPECT_EQ(b.at_left("left 3"), "right 3");
+    nh = b.extract_left("left 3");
+  }
+  EXPECT_EQ(nh.right(), "right 3");
+}
+
+TEST(bimap, node_handle_move_only) {
+  bimap<test_object, test_object> a, b;
+  a.insert(test_object(1), test_object(2));
+  a.insert(test_object(3), test_object(4));
+  EXPECT_TRUE(b.insert(a.extract_left(test_object(1))).inserted);
+  EXPECT_EQ(b.at_left(test_object(1)).a, 2);
+  EXPECT_EQ(a.size(), 1);
+  auto nh = a.extract_right(test_object(4));
+  EXPECT_TRUE(a.empty());
+}
+
+TEST(bimap, insert_batch) {
+  bimap<int, int> b;
+  b.insert(1, 10);
+  b.insert(5, 50);
+  std::vector<std::pair<int, int>> batch = {
+      {3, 30}, {1, 11}, {2, 50}, {4, 40}, {3, 31}, {6, 40}, {0, 0}};
+  std::vector<std::pair<int, int>> rejected;
+  EXPECT_EQ(b.insert_batch(batch.begin(), batch.end(), std::back_inserter(rejected)), 3);
+  EXPECT_EQ(b.size(), 5);
+  EXPECT_EQ(rejected, (std::vector<std::pair<int, int>>{{1, 11}, {2, 50}, {3, 31}, {6, 40}}));
+  EXPECT_EQ(b.at_left(3), 30);
+  EXPECT_EQ(b.at_right(40), 4);
+  EXPECT_EQ(*b.begin_left(), 0);
+  EXPECT_EQ(*std::prev(b.end_right()), 50);
+
+  EXPECT_EQ(b.insert_batch(batch.begin(), batch.begin()), 0);
+  std::vector<std::pair<int, int>> more = {{7, 70}, {8, 80}};
+  EXPECT_EQ(b.insert_batch(more.begin(), more.end()), 2);
+  EXPECT_EQ(b.at_right(80), 8);
+}
+
+// Выходной итератор, который бросает при первой записи.
+struct throwing_output {
+  throwing_output &operator*() { return *this; }
+  throwing_output &operator++() { return *this; }
+  template<typename T>
+  throwing_output &operator=(T const &) {
+    throw std::runtime_error("throwing_output");
+  }
+};
+
+TEST(bimap, insert_batch_rejected_throws) {
+  bimap<std::shared_ptr<int>, int> b;
+  std::vector<std::shared_ptr<int>> keys;
+  std::vector<std::pair<std::shared_ptr<int>, int>> batch;
+  for (int i = 0; i < 6; i++) {
+    keys.push_back(std::make_shared<int>(i));
+    batch.emplace_back(keys.back(), i % 3);
+  }
+  EXPECT_THROW(b.insert_batch(batch.begin(), batch.end(), throwing_output()), std::runtime_error);
+  EXPECT_EQ(b.size(), 3);
+  batch.clear();
+  // Ключи отвергнутых пар освобождены вместе с узлами.
+  size_t in_bimap = 0;
+  for (auto &key : keys) {
+    EXPECT_LE(key.use_count(), 2);
+    in_bimap += key.use_count() == 2;
+  }
+  EXPECT_EQ(in_bimap, 3);
+}
+
+TEST(bimap, set_algebra) {
+  bimap<int, int> a, b;
+  a.insert(1, 10);
+  a.insert(2, 20);
+  a.insert(3, 30);
+  b.insert(2, 20);
+  b.insert(3, 31);
+  b.insert(4, 40);
+  b.insert(5, 10);
+
+  auto u = bimap_union(a, b);
+  EXPECT_EQ(u.size(), 4);
+  EXPECT_EQ(u.at_left(3), 30);
+  EXPECT_EQ(u.at_left(4), 40);
+  EXPECT_EQ(u.find_left(5), u.end_left());
+
+  auto i = bimap_intersection(a, b);
+  EXPECT_EQ(i.size(), 1);
+  EXPECT_EQ(i.at_right(20), 2);
+
+  auto d = bimap_difference(a, b);
+  EXPECT_EQ(d.size(), 2);
+  EXPECT_EQ(d.at_left(1), 10);
+  EXPECT_EQ(d.at_right(30), 3);
+  EXPECT_EQ(d.find_right(20), d.end_right());
+
+  EXPECT_EQ(bimap_union(a, bimap<int, int>()), a);
+  EXPECT_TRUE(bimap_intersection(bimap<int, int>(), a).empty());
+}
+
+TEST(bimap, freeze) {
+  bimap<int, std::string> b;
+  for (int i = 0; i < 10; i++) {
+    b.insert(2 * i, std::to_string(i));
+  }
+  auto f = b.freeze();
+  b.erase_left(4);
+  EXPECT_EQ(f.size(), 10);
+  EXPECT_EQ(f.at_left(4), "2");
+  EXPECT_EQ(f.at_right("9"), 18);
+  EXPECT_THROW(f.at_left(5), std::out_of_range);
+  EXPECT_EQ(f.find_left(5), f.end_left());
+  EXPECT_EQ(*f.find_right("3").flip(), 6);
+  EXPECT_EQ(*f.lower_bound_left(5), 6);
+  EXPECT_EQ(*f.upper_bound_left(6), 8);
+  EXPECT_EQ(f.lower_bound_left(19), f.end_left());
+  EXPECT_EQ(*f.lower_bound_right("10"), "2");
+
+  int expected = 0;
+  for (auto it = f.begin_left(); it != f.end_left(); ++it) {
+    EXPECT_EQ(*it, expected);
+    expected += 2;
+  }
+  auto last = f.end_right();
+  EXPECT_EQ(*--last, "9");
+  EXPECT_EQ(*--last, "8");
+
+  auto empty = bimap<int, int>().freeze();
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(empty.begin_left(), empty.end_left());
+}
+
+using counted_bimap = bimap<int, int, std::less<int>, std::less<int>,
+                            std::allocator<std::pair<int, int>>,
+                            bimap_statistics_policy>;
+
+TEST(bimap, statistics) {
+  counted_bimap b;
+  for (int i = 0; i < 100; i++) {
+    b.insert(i, 100 - i);
+  }
+  auto s = b.stats();
+  EXPECT_EQ(s.operations, 100);
+  EXPECT_EQ(s.allocations, 100);
+  EXPECT_EQ(s.frees, 0);
+  EXPECT_EQ(s.splits, 200);
+  EXPECT_EQ(s.merges, 0);
+  EXPECT_GT(s.comparisons, 0);
+  EXPECT_GT(s.comparisons_per_operation(), 0);
+
+  for (auto const *side : {&s.left, &s.right}) {
+    size_t nodes = 0;
+    for (size_t count : side->depth_histogram) {
+      nodes += count;
+    }
+    EXPECT_EQ(nodes, 100);
+    EXPECT_EQ(side->depth_histogram[0], 1);
+    EXPECT_EQ(side->max_depth + 1, side->depth_histogram.size());
+    EXPECT_LE(side->average_depth, side->max_depth);
+  }
+
+  b.reset_stats();
+  b.find_left(5);
+  b.find_right(1000);
+  EXPECT_EQ(b.at_left(7), 93);
+  b.lower_bound_left(50);
+  b.erase_left(5);
+  b.erase_right(1000);
+  s = b.stats();
+  EXPECT_EQ(s.operations, 6);
+  EXPECT_EQ(s.allocations, 0);
+  EXPECT_EQ(s.frees, 1);
+  EXPECT_EQ(s.splits, 0);
+  EXPECT_EQ(s.merges, 2);
+
+  b.clear();
+  s = b.stats();
+  EXPECT_EQ(s.frees, 100);
+  EXPECT_EQ(s.left.max_depth, 0);
+  EXPECT_TRUE(s.right.depth_histogram.empty());
+}
+
+bool int_greater(int const &a, int const &b) {
+  return a > b;
+}
+
+// Компаратор -- указатель на функцию: унаследовать от него нельзя.
+TEST(bimap, statistics_with_function_pointer_compare) {
+  using compare = bool (*)(int const &, int const &);
+  bimap<int, int, compare, compare, std::allocator<std::pair<int, int>>, bimap_statistics_policy> b(
+      int_greater, int_greater);
+  for (int i = 0; i < 10; i++) {
+    b.insert(i, -i);
+  }
+  EXPECT_EQ(*b.begin_left(), 9);
+  EXPECT_EQ(*b.begin_right(), 0);
+  EXPECT_EQ(b.at_left(3), -3);
+  EXPECT_GT(b.stats().comparisons, 0);
+  auto copy = b;
+  EXPECT_EQ(*copy.begin_left(), 9);
+}
+
+TEST(bimap, statistics_with_parallel_set_algebra) {
+  counted_bimap a;
+  counted_bimap b;
+  for (int i = 0; i < 100000; i++) {
+    a.insert(2 * i, 2 * i);
+    b.insert(3 * i, 3 * i);
+  }
+  // Общие пары -- кратные 6 ниже 200000.
+  auto u = bimap_union(a, b);
+  auto s = u.stats();
+  EXPECT_EQ(u.size(), 166666);
+  EXPECT_EQ(s.allocations - s.frees, u.size());
+  EXPECT_GT(s.comparisons, 0);
+
+  auto common = bimap_intersection(a, b);
+  s = common.stats();
+  EXPECT_EQ(common.size(), 33334);
+  EXPECT_EQ(s.allocations - s.frees, common.size());
+
+  a.reset_stats();
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&a] {
+      for (int i = 0; i < 10000; i++) {
+        EXPECT_NE(a.find_left(2 * i), a.end_left());
+      }
+    });
+  }
+  for (auto &r : readers) {
+    r.join();
+  }
+  EXPECT_EQ(a.stats().operations, 40000);
+}
+
+TEST(bimap, statistics_stay_with_object) {
+  counted_bimap a;
+  for (int i = 0; i < 10; i++) {
+    a.insert(i, i);
+  }
+  counted_bimap b = a;
+  b.reset_stats();
+  size_t a_comparisons = a.stats().comparisons;
+  b.find_left(3);
+  EXPECT_EQ(b.stats().operations, 1);
+  EXPECT_GT(b.stats().comparisons, 0);
+  EXPECT_EQ(a.stats().comparisons, a_comparisons);
+
+  counted_bimap c = std::move(b);
+  c.find_left(4);
+  EXPECT_EQ(c.stats().operations, 1);
+  EXPECT_EQ(b.stats().operations, 1);
+
+  b = std::move(c);
+  b.reset_stats();
+  c.reset_stats();
+  b.find_right(5);
+  EXPECT_EQ(b.stats().operations, 1);
+  EXPECT_GT(b.stats().comparisons, 0);
+  EXPECT_EQ(c.stats().comparisons, 0);
+
+  c = a;
+  c.reset_stats();
+  c.find_left(6);
+  EXPECT_GT(c.stats().comparisons, 0);
+  EXPECT_EQ(a.stats().comparisons, a_comparisons);
+}
+
 template <typename T>
 std::vector<std::pair<T, T>>
 eliminate_same(std::vector<T> &lefts, std::vector<T> &rights, std::mt19937 &e) {
@@ -432,3 +1110,1076 @@ TEST(bimap_randomized, compare_to_two_maps) {
   std::cout << "Performed " << ins << " insertions and " << total - ins - skip
             << " erasures. " << skip << " skipped." << std::endl;
 }
+
+TEST(bimap_randomized, bounds_compare_to_set) {
+  bimap<int, int> b;
+  std::set<int> lefts;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 5000; i++) {
+    int l = e() % 20000, r = e();
+    if (b.insert(l, r) != b.end_left()) {
+      lefts.insert(l);
+    }
+  }
+  for (int key = -1; key <= 20001; key++) {
+    auto lb = lefts.lower_bound(key);
+    auto ub = lefts.upper_bound(key);
+    auto blb = b.lower_bound_left(key);
+    auto bub = b.upper_bound_left(key);
+    EXPECT_EQ(lb == lefts.end(), blb == b.end_left());
+    EXPECT_EQ(ub == lefts.end(), bub == b.end_left());
+    if (lb != lefts.end()) {
+      EXPECT_EQ(*lb, *blb);
+    }
+    if (ub != lefts.end()) {
+      EXPECT_EQ(*ub, *bub);
+    }
+  }
+}
+
+TEST(bimap_randomized, construct_sorted_compare_to_insert) {
+  std::mt19937 e(seed);
+  std::vector<uint32_t> lefts(30000), rights(30000);
+  for (size_t i = 0; i < lefts.size(); i++) {
+    lefts[i] = e();
+    rights[i] = e();
+  }
+  std::sort(lefts.begin(), lefts.end());
+  std::sort(rights.begin(), rights.end());
+  auto data = eliminate_same(lefts, rights, e);
+  std::sort(data.begin(), data.end());
+
+  bimap<uint32_t, uint32_t> inserted;
+  for (auto const &p : data) {
+    inserted.insert(p.first, p.second);
+  }
+  bimap<uint32_t, uint32_t> built(data.begin(), data.end());
+  EXPECT_EQ(built.size(), inserted.size());
+  EXPECT_EQ(built, inserted);
+  uint32_t previous = *built.begin_right();
+  for (auto it = ++built.begin_right(); it != built.end_right(); it++) {
+    EXPECT_GT(*it, previous);
+    previous = *it;
+  }
+}
+
+TEST(bimap_randomized, order_statistics_compare_to_vector) {
+  ranked_bimap b;
+  std::set<int> lefts, rights;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 20000; i++) {
+    if (e() % 3 != 0 || b.empty()) {
+      int l = e() % 50000, r = e() % 50000;
+      if (b.insert(l, r) != b.end_left()) {
+        lefts.insert(l);
+        rights.insert(r);
+      }
+    } else {
+      auto it = b.nth_left(e() % b.size());
+      lefts.erase(*it);
+      rights.erase(*it.flip());
+      b.erase_left(it);
+    }
+    if (i % 1000 == 0) {
+      std::vector<int> l(lefts.begin(), lefts.end()), r(rights.begin(), rights.end());
+      for (size_t k = 0; k < l.size(); k++) {
+        EXPECT_EQ(*b.nth_left(k), l[k]);
+        EXPECT_EQ(*b.nth_right(k), r[k]);
+      }
+      for (int key = 0; key < 50000; key += 97) {
+        EXPECT_EQ(b.rank_left(key), std::lower_bound(l.begin(), l.end(), key) - l.begin());
+        EXPECT_EQ(b.rank_right(key), std::lower_bound(r.begin(), r.end(), key) - r.begin());
+      }
+    }
+  }
+  std::vector<std::pair<int, int>> pairs;
+  for (auto it = b.begin_left(); it != b.end_left(); it++) {
+    pairs.emplace_back(*it, *it.flip());
+  }
+  ranked_bimap built(pairs.begin(), pairs.end());
+  for (size_t k = 0; k < pairs.size(); k += 7) {
+    EXPECT_EQ(*built.nth_left(k), pairs[k].first);
+    EXPECT_EQ(built.rank_right(*b.nth_right(k)), k);
+  }
+}
+
+TEST(bimap_randomized, insert_hint_compare_to_insert) {
+  ranked_bimap hinted, plain;
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 20000; i++) {
+    int l = e() % 30000, r = e() % 30000;
+    auto hint_left = e() % 2 == 0 || hinted.empty() ? hinted.lower_bound_left(l) : hinted.nth_left(e() % hinted.size());
+    auto hint_right = e() % 2 == 0 || hinted.empty() ? hinted.upper_bound_right(r)
+                                                      : hinted.nth_right(e() % hinted.size());
+    bool inserted = hinted.insert(hint_left, hint_right, l, r) != hinted.end_left();
+    EXPECT_EQ(inserted, plain.insert(l, r) != plain.end_left());
+  }
+  ASSERT_EQ(hinted.size(), plain.size());
+  auto it = plain.begin_left();
+  for (size_t k = 0; k < plain.size(); k++, it++) {
+    EXPECT_EQ(*hinted.nth_left(k), *it);
+    EXPECT_EQ(*hinted.nth_right(k), *plain.nth_right(k));
+    EXPECT_EQ(hinted.rank_left(*it), k);
+  }
+}
+
+TEST(bimap_randomized, erase_range_compare_to_map) {
+  ranked_bimap b;
+  std::map<int, int> lefts, rights;
+  std::mt19937 e(seed);
+  for (size_t round = 0; round < 200; round++) {
+    for (size_t i = 0; i < 200; i++) {
+      int l = e() % 100000, r = e() % 100000;
+      if (b.insert(l, r) != b.end_left()) {
+        lefts[l] = r;
+        rights[r] = l;
+      }
+    }
+    int from = e() % 100000, to = from + e() % 20000;
+    if (round % 2 == 0) {
+      auto it = b.erase_left(b.lower_bound_left(from), b.lower_bound_left(to));
+      EXPECT_EQ(it, b.lower_bound_left(to));
+      for (auto lit = lefts.lower_bound(from); lit != lefts.lower_bound(to); lit = lefts.erase(lit)) {
+        rights.erase(lit->second);
+      }
+    } else {
+      b.erase_right(b.lower_bound_right(from), b.end_right());
+      for (auto rit = rights.lower_bound(from); rit != rights.end(); rit = rights.erase(rit)) {
+        lefts.erase(rit->second);
+      }
+    }
+    ASSERT_EQ(b.size(), lefts.size());
+    auto lit = lefts.begin();
+    auto rit = rights.begin();
+    for (size_t k = 0; k < lefts.size(); k += 13, std::advance(lit, 13), std::advance(rit, 13)) {
+      EXPECT_EQ(*b.nth_left(k), lit->first);
+      EXPECT_EQ(*b.nth_left(k).flip(), lit->second);
+      EXPECT_EQ(*b.nth_right(k), rit->first);
+      if (lefts.size() - k <= 13) {
+        break;
+      }
+    }
+  }
+}
+
+static_assert(sizeof(bimap<int, int>::left_iterator) == sizeof(void *));
+
+// begin и --end берутся из заголовков деревьев: проверяем, что крайние
+// узлы не теряются ни одной из меняющих деревья операций.
+TEST(bimap_randomized, begin_end_compare_to_map) {
+  bimap<int, int> b;
+  std::map<int, int> lefts, rights;
+  std::mt19937 e(seed);
+  auto erase_pair = [&](int l) {
+    rights.erase(lefts[l]);
+    lefts.erase(l);
+  };
+  for (size_t i = 0; i < 20000; i++) {
+    int l = e() % 5000, r = e() % 5000;
+    switch (e() % 8) {
+    case 0:
+      if (b.insert(l, r) != b.end_left()) {
+        lefts[l] = r;
+        rights[r] = l;
+      }
+      break;
+    case 1:
+      if (b.insert(b.end_left(), b.end_right(), l, r) != b.end_left()) {
+        lefts[l] = r;
+        rights[r] = l;
+      }
+      break;
+    case 2:
+      if (b.erase_left(l)) {
+        erase_pair(l);
+      }
+      break;
+    case 3:
+      if (!b.empty()) {
+        erase_pair(*b.begin_left());
+        b.erase_left(b.begin_left());
+      }
+      break;
+    case 4:
+      if (!b.empty()) {
+        erase_pair(*std::prev(b.end_right()).flip());
+        b.erase_right(std::prev(b.end_right()));
+      }
+      break;
+    case 5:
+      b.erase_left(b.lower_bound_left(l), b.end_left());
+      while (!lefts.empty() && lefts.rbegin()->first >= l) {
+        erase_pair(lefts.rbegin()->first);
+      }
+      break;
+    case 6: {
+      std::vector<std::pair<int, int>> batch{{l, r}, {l + 5000, r + 5000}};
+      b.insert_batch(batch.begin(), batch.end());
+      lefts.clear();
+      rights.clear();
+      for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+        lefts[*it] = *it.flip();
+        rights[*it.flip()] = *it;
+      }
+      break;
+    }
+    default: {
+      bimap<int, int> moved(std::move(b));
+      b = bimap<int, int>(moved);
+      break;
+    }
+    }
+    ASSERT_EQ(b.size(), lefts.size());
+    if (b.empty()) {
+      EXPECT_EQ(b.begin_left(), b.end_left());
+      EXPECT_EQ(b.begin_right(), b.end_right());
+      continue;
+    }
+    EXPECT_EQ(*b.begin_left(), lefts.begin()->first);
+    EXPECT_EQ(*std::prev(b.end_left()), lefts.rbegin()->first);
+    EXPECT_EQ(*b.begin_right(), rights.begin()->first);
+    EXPECT_EQ(*std::prev(b.end_right()), rights.rbegin()->first);
+  }
+}
+
+TEST(bimap_randomized, insert_batch_compare_to_insert) {
+  std::mt19937 e(seed);
+  ranked_bimap b;
+  for (size_t round = 0; round < 20; round++) {
+    size_t m = round % 4 == 0 ? 2000 : e() % 300;
+    std::vector<std::pair<int, int>> batch;
+    for (size_t i = 0; i < m; i++) {
+      batch.emplace_back(e() % 5000, e() % 5000);
+    }
+
+    ranked_bimap expected(b);
+    std::vector<std::pair<int, int>> expected_rejected;
+    std::vector<char> kept(m, true);
+    for (size_t i = 0; i < m; i++) {
+      kept[i] = b.find_left(batch[i].first) == b.end_left() && b.find_right(batch[i].second) == b.end_right();
+    }
+    std::set<int> lefts, rights;
+    for (size_t i = 0; i < m; i++) {
+      kept[i] = kept[i] && lefts.insert(batch[i].first).second;
+    }
+    for (size_t i = 0; i < m; i++) {
+      kept[i] = kept[i] && rights.insert(batch[i].second).second;
+    }
+    for (size_t i = 0; i < m; i++) {
+      if (kept[i]) {
+        expected.insert(batch[i].first, batch[i].second);
+      } else {
+        expected_rejected.push_back(batch[i]);
+      }
+    }
+
+    std::vector<std::pair<int, int>> rejected;
+    size_t inserted = b.insert_batch(batch.begin(), batch.end(), std::back_inserter(rejected));
+    ASSERT_EQ(inserted + rejected.size(), m);
+    ASSERT_EQ(rejected, expected_rejected);
+    ASSERT_EQ(b, expected);
+    for (size_t k = 0; k < b.size(); k += 97) {
+      ASSERT_EQ(*b.nth_right(k), *expected.nth_right(k));
+    }
+  }
+}
+
+TEST(bimap_randomized, set_algebra_compare_to_sets) {
+  std::mt19937 e(seed);
+  // Больше parallel_cutoff, чтобы обход делился между потоками.
+  ranked_bimap a, b;
+  for (size_t i = 0; i < 40000; i++) {
+    a.insert(e() % 100000, e() % 100000);
+    if (i % 2 == 0) {
+      b.insert(e() % 100000, e() % 100000);
+    } else {
+      auto it = std::next(a.begin_left(), e() % a.size());
+      b.insert(*it, e() % 2 == 0 ? *it.flip() : static_cast<int>(e() % 100000));
+    }
+  }
+  std::set<std::pair<int, int>> pa, pb;
+  for (auto it = a.begin_left(); it != a.end_left(); ++it) {
+    pa.emplace(*it, *it.flip());
+  }
+  for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+    pb.emplace(*it, *it.flip());
+  }
+
+  auto pairs_of = [](ranked_bimap const &m) {
+    std::set<std::pair<int, int>> res;
+    size_t k = 0;
+    for (auto it = m.begin_right(); it != m.end_right(); ++it, ++k) {
+      EXPECT_EQ(*m.nth_right(k), *it);
+      res.emplace(*it.flip(), *it);
+    }
+    EXPECT_EQ(res.size(), m.size());
+    return res;
+  };
+
+  std::set<std::pair<int, int>> expected;
+  std::set_intersection(pa.begin(), pa.end(), pb.begin(), pb.end(), std::inserter(expected, expected.end()));
+  EXPECT_EQ(pairs_of(bimap_intersection(a, b)), expected);
+
+  expected.clear();
+  std::set_difference(pa.begin(), pa.end(), pb.begin(), pb.end(), std::inserter(expected, expected.end()));
+  EXPECT_EQ(pairs_of(bimap_difference(a, b)), expected);
+
+  ranked_bimap expected_union(a);
+  for (auto const &p : pb) {
+    expected_union.insert(p.first, p.second);
+  }
+  auto u = bimap_union(a, b);
+  EXPECT_EQ(pairs_of(u), pairs_of(expected_union));
+  EXPECT_EQ(u, expected_union);
+}
+
+TEST(bimap_randomized, freeze_compare_to_bimap) {
+  std::mt19937 e(seed);
+  for (size_t n : {1, 2, 7, 8, 9, 1000, 4095, 4096, 5000}) {
+    bimap<int, int> b;
+    while (b.size() < n) {
+      b.insert(e() % 100000, e() % 100000);
+    }
+    auto f = b.freeze();
+    ASSERT_EQ(f.size(), b.size());
+
+    auto fit = f.begin_right();
+    for (auto it = b.begin_right(); it != b.end_right(); ++it, ++fit) {
+      ASSERT_EQ(*fit, *it);
+      ASSERT_EQ(*fit.flip(), *it.flip());
+      ASSERT_EQ(*fit.flip().flip(), *it);
+    }
+    EXPECT_EQ(fit, f.end_right());
+    auto back = f.end_left();
+    for (auto it = b.end_left(); it != b.begin_left();) {
+      ASSERT_EQ(*--back, *--it);
+    }
+
+    for (size_t i = 0; i < 1000; i++) {
+      int key = e() % 100002 - 1;
+      auto lb = b.lower_bound_left(key);
+      auto ub = b.upper_bound_right(key);
+      auto flb = f.lower_bound_left(key);
+      auto fub = f.upper_bound_right(key);
+      ASSERT_EQ(lb == b.end_left(), flb == f.end_left());
+      ASSERT_EQ(ub == b.end_right(), fub == f.end_right());
+      if (lb != b.end_left()) {
+        EXPECT_EQ(*flb, *lb);
+        EXPECT_EQ(*flb.flip(), *lb.flip());
+      }
+      if (ub != b.end_right()) {
+        EXPECT_EQ(*fub, *ub);
+      }
+      EXPECT_EQ(f.find_right(key) == f.end_right(), b.find_right(key) == b.end_right());
+    }
+  }
+}
+
+TEST(bimap, save_and_map) {
+  bimap<int, double> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i * 3, i * 0.5 - 100);
+  }
+  std::string path = testing::TempDir() + "bimap_save_and_map.bin";
+  save_bimap(b, path);
+
+  mapped_bimap<int, double> m(path);
+  EXPECT_EQ(m.size(), b.size());
+  EXPECT_EQ(m.at_left(300), b.at_left(300));
+  EXPECT_EQ(m.at_right(-100), 0);
+  EXPECT_THROW(m.at_left(301), std::out_of_range);
+  EXPECT_EQ(m.find_right(0.25), m.end_right());
+  EXPECT_EQ(*m.lower_bound_left(301), 303);
+  EXPECT_EQ(*m.upper_bound_right(-100), -99.5);
+  EXPECT_EQ(m.lower_bound_left(3000), m.end_left());
+
+  auto mit = m.begin_right();
+  for (auto it = b.begin_right(); it != b.end_right(); ++it, ++mit) {
+    EXPECT_EQ(*mit, *it);
+    EXPECT_EQ(*mit.flip(), *it.flip());
+  }
+  EXPECT_EQ(mit, m.end_right());
+
+  mapped_bimap<int, double> moved(std::move(m));
+  EXPECT_EQ(moved.at_left(3), -99.5);
+
+  EXPECT_THROW((mapped_bimap<int, float>(path)), std::runtime_error);
+  EXPECT_THROW((mapped_bimap<int, int>(testing::TempDir() + "no_such_bimap.bin")), std::system_error);
+  std::remove(path.c_str());
+
+  save_bimap(bimap<int, int>(), path);
+  EXPECT_TRUE((mapped_bimap<int, int>(path).empty()));
+  std::remove(path.c_str());
+}
+
+TEST(bimap, map_rejects_corrupt_file) {
+  bimap<int, int> b;
+  for (int i = 0; i < 100; i++) {
+    b.insert(i, -i);
+  }
+  std::string path = testing::TempDir() + "bimap_corrupt.bin";
+  save_bimap(b, path);
+  auto header = mapped_bimap_header::describe<int, int>(100);
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(static_cast<std::streamoff>(header.right_partner + 5 * sizeof(std::uint64_t)));
+    std::uint64_t bad = 1000000;
+    file.write(reinterpret_cast<const char *>(&bad), sizeof(bad));
+  }
+  // Ранги проверяются при обращении: открытие не читает массивы.
+  {
+    mapped_bimap<int, int> m(path);
+    int right = -94; // ранг 5 среди right
+    EXPECT_EQ(m.find_right(right).flip(), m.end_left());
+    EXPECT_THROW(m.at_right(right), std::runtime_error);
+    EXPECT_EQ(m.at_left(6), -6);
+    EXPECT_EQ(*m.find_left(6).flip(), -6);
+  }
+
+  save_bimap(b, path);
+  std::filesystem::resize_file(path, header.right_partner);
+  EXPECT_THROW((mapped_bimap<int, int>(path)), std::runtime_error);
+  std::remove(path.c_str());
+
+  try {
+    save_bimap(b, testing::TempDir() + "no_such_dir/bimap.bin");
+    FAIL();
+  } catch (std::system_error const &e) {
+    EXPECT_EQ(e.code(), std::errc::no_such_file_or_directory);
+  }
+}
+
+TEST(unordered_bimap, simple) {
+  unordered_bimap<int, int> b;
+  EXPECT_TRUE(b.empty());
+  EXPECT_NE(b.insert(4, 10), b.end_left());
+  EXPECT_NE(b.insert(10, 4), b.end_left());
+  EXPECT_EQ(b.insert(4, 5), b.end_left());
+  EXPECT_EQ(b.insert(5, 4), b.end_left());
+  EXPECT_EQ(b.size(), 2);
+  EXPECT_EQ(*b.find_right(4).flip(), 10);
+  EXPECT_EQ(b.at_left(10), 4);
+  EXPECT_EQ(b.at_right(10), 4);
+  EXPECT_THROW(b.at_left(1), std::out_of_range);
+  EXPECT_EQ(b.find_left(7), b.end_left());
+}
+
+TEST(unordered_bimap, erase) {
+  unordered_bimap<std::string, int> b;
+  b.insert("one", 1);
+  b.insert("two", 2);
+  b.insert("three", 3);
+  b.insert("four", 4);
+  EXPECT_TRUE(b.erase_left("two"));
+  EXPECT_FALSE(b.erase_left("two"));
+  EXPECT_TRUE(b.erase_right(4));
+  EXPECT_EQ(b.size(), 2);
+  EXPECT_EQ(b.at_left("three"), 3);
+  EXPECT_EQ(b.at_right(1), "one");
+
+  b.erase_left(b.begin_left(), b.end_left());
+  EXPECT_TRUE(b.empty());
+}
+
+TEST(unordered_bimap, erase_while_iterating) {
+  unordered_bimap<int, int> b;
+  for (int i = 0; i < 100; i++) {
+    b.insert(i, -i);
+  }
+  int visited = 0;
+  for (auto it = b.begin_left(); it != b.end_left();) {
+    visited++;
+    if (*it % 3 == 0) {
+      it = b.erase_left(it);
+    } else {
+      ++it;
+    }
+  }
+  EXPECT_EQ(visited, 100);
+  EXPECT_EQ(b.size(), 66);
+  for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+    EXPECT_NE(*it % 3, 0);
+    EXPECT_EQ(*it.flip(), -*it);
+  }
+
+  auto first = b.begin_left();
+  std::advance(first, 10);
+  auto last = std::next(first, 20);
+  int after = *last;
+  EXPECT_EQ(*b.erase_left(first, last), after);
+  EXPECT_EQ(b.size(), 46);
+}
+
+TEST(unordered_bimap, at_or_default) {
+  unordered_bimap<int, int> b;
+  b.insert(4, 2);
+  EXPECT_EQ(b.at_left_or_default(5), 0);
+  EXPECT_EQ(b.at_right(0), 5);
+  EXPECT_EQ(b.at_left_or_default(42), 0);
+  EXPECT_EQ(b.at_right(0), 42);
+  EXPECT_EQ(b.find_left(5), b.end_left());
+}
+
+struct test_object_hash {
+  size_t operator()(test_object const &x) const { return std::hash<int>()(x.a); }
+};
+
+TEST(unordered_bimap, move_only_values) {
+  unordered_bimap<int, test_object, std::hash<int>, test_object_hash> b;
+  for (int i = 0; i < 100; i++) {
+    b.insert(i, test_object(i + 1000));
+  }
+  for (int i = 0; i < 100; i += 2) {
+    EXPECT_TRUE(b.erase_left(i));
+  }
+  EXPECT_EQ(b.size(), 50);
+  for (int i = 1; i < 100; i += 2) {
+    EXPECT_EQ(b.at_left(i).a, i + 1000);
+    EXPECT_EQ(b.at_right(test_object(i + 1000)), i);
+  }
+}
+
+TEST(unordered_bimap_randomized, compare_to_bimap) {
+  unordered_bimap<int, int> u;
+  bimap<int, int> b;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 50000; i++) {
+    if (e() % 10 > 2 || b.empty()) {
+      int l = e() % 30000, r = e() % 30000;
+      bool inserted = b.insert(l, r) != b.end_left();
+      EXPECT_EQ(u.insert(l, r) != u.end_left(), inserted);
+    } else {
+      auto it = b.lower_bound_left(e() % 30000);
+      if (it == b.end_left()) {
+        it = b.begin_left();
+      }
+      if (e() % 2 == 0) {
+        EXPECT_TRUE(u.erase_left(*it));
+      } else {
+        EXPECT_TRUE(u.erase_right(*it.flip()));
+      }
+      b.erase_left(it);
+    }
+    if (i % 1000 == 0) {
+      EXPECT_EQ(u.size(), b.size());
+      for (auto it = b.begin_left(); it != b.end_left(); it++) {
+        EXPECT_EQ(u.at_left(*it), *it.flip());
+        EXPECT_EQ(u.at_right(*it.flip()), *it);
+      }
+    }
+  }
+  unordered_bimap<int, int> copy(u);
+  EXPECT_EQ(copy, u);
+  copy.erase_left(copy.begin_left());
+  EXPECT_NE(copy, u);
+}
+
+TEST(compact_bimap, simple) {
+  compact_bimap<std::uint32_t, std::uint32_t> b;
+  EXPECT_TRUE(b.empty());
+  EXPECT_NE(b.insert(4, 10), b.end_left());
+  EXPECT_NE(b.insert(10, 4), b.end_left());
+  EXPECT_EQ(b.insert(4, 5), b.end_left());
+  EXPECT_EQ(b.insert(5, 4), b.end_left());
+  EXPECT_EQ(b.size(), 2);
+  EXPECT_EQ(*b.find_right(4).flip(), 10);
+  EXPECT_EQ(b.at_left(10), 4);
+  EXPECT_THROW(b.at_left(1), std::out_of_range);
+  EXPECT_EQ(*b.lower_bound_left(5), 10);
+  EXPECT_EQ(b.upper_bound_right(10), b.end_right());
+  EXPECT_EQ(*--b.end_left(), 10);
+
+  b.reserve(100);
+  EXPECT_EQ(b.memory_usage(), 100 * 36);
+}
+
+TEST(compact_bimap, erase_while_iterating) {
+  compact_bimap<int, test_object, std::less<int>, test_object_compare> b;
+  for (int i = 0; i < 100; i++) {
+    b.insert(i, test_object(-i));
+  }
+  int expected = 0;
+  for (auto it = b.begin_left(); it != b.end_left(); expected++) {
+    EXPECT_EQ(*it, expected);
+    if (*it % 3 == 0) {
+      it = b.erase_left(it);
+    } else {
+      ++it;
+    }
+  }
+  EXPECT_EQ(expected, 100);
+  EXPECT_EQ(b.size(), 66);
+  int prev = -1;
+  for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+    EXPECT_NE(*it % 3, 0);
+    EXPECT_LT(prev, *it);
+    EXPECT_EQ((*it.flip()).a, -*it);
+    prev = *it;
+  }
+}
+
+// Ключ, копирование которого бросает после copies_left копий. Все
+// экземпляры делят tracker: по use_count видно, сколько их живо.
+struct limited_copy {
+  static inline int copies_left = 0;
+  int a;
+  std::shared_ptr<int> tracker;
+  limited_copy(int a, std::shared_ptr<int> tracker) : a(a), tracker(std::move(tracker)) {}
+  limited_copy(limited_copy const &other) : a(other.a), tracker(other.tracker) {
+    if (copies_left-- == 0) {
+      throw std::runtime_error("limited_copy");
+    }
+  }
+  friend bool operator<(limited_copy const &c, limited_copy const &b) {
+    return c.a < b.a;
+  }
+};
+
+TEST(compact_bimap, copy_throws) {
+  auto tracker = std::make_shared<int>();
+  limited_copy::copies_left = 1000;
+  compact_bimap<limited_copy, int> b;
+  for (int i = 0; i < 20; i++) {
+    b.insert(limited_copy(i, tracker), i);
+  }
+  ASSERT_EQ(tracker.use_count(), 21);
+  limited_copy::copies_left = 10;
+  EXPECT_THROW((compact_bimap<limited_copy, int>(b)), std::runtime_error);
+  EXPECT_EQ(tracker.use_count(), 21);
+}
+
+TEST(compact_bimap_randomized, compare_to_bimap) {
+  compact_bimap<int, int> c;
+  bimap<int, int> b;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 50000; i++) {
+    if (e() % 10 > 2 || b.empty()) {
+      int l = e() % 30000, r = e() % 30000;
+      bool inserted = b.insert(l, r) != b.end_left();
+      EXPECT_EQ(c.insert(l, r) != c.end_left(), inserted);
+    } else {
+      auto it = b.lower_bound_left(e() % 30000);
+      if (it == b.end_left()) {
+        it = b.begin_left();
+      }
+      if (e() % 2 == 0) {
+        EXPECT_TRUE(c.erase_left(*it));
+      } else {
+        EXPECT_TRUE(c.erase_right(*it.flip()));
+      }
+      b.erase_left(it);
+    }
+    if (i % 1000 == 0) {
+      EXPECT_EQ(c.size(), b.size());
+      EXPECT_TRUE(std::equal(b.begin_left(), b.end_left(), c.begin_left(), c.end_left()));
+      EXPECT_TRUE(std::equal(b.begin_right(), b.end_right(), c.begin_right(), c.end_right()));
+      for (auto it = c.begin_right(); it != c.end_right(); it++) {
+        EXPECT_EQ(b.at_right(*it), *it.flip());
+      }
+    }
+  }
+  compact_bimap<int, int> copy(c);
+  EXPECT_EQ(copy, c);
+  copy.erase_left(copy.begin_left());
+  EXPECT_NE(copy, c);
+  compact_bimap<int, int> moved(std::move(copy));
+  EXPECT_TRUE(copy.empty());
+  EXPECT_EQ(copy.begin_left(), copy.end_left());
+  EXPECT_EQ(moved.size(), c.size() - 1);
+}
+
+TEST(lru_bimap, eviction) {
+  lru_bimap<int, std::string> b(3);
+  b.insert(1, "one");
+  b.insert(2, "two");
+  b.insert(3, "three");
+  EXPECT_EQ(*b.least_recent(), 1);
+  EXPECT_EQ(b.at_left(1), "one");
+  EXPECT_EQ(*b.least_recent(), 2);
+  EXPECT_EQ(*b.find_right("two").flip(), 2);
+  EXPECT_EQ(b.insert(4, "three"), b.end_left());
+  EXPECT_NE(b.insert(4, "four"), b.end_left());
+  EXPECT_EQ(b.size(), 3);
+  EXPECT_EQ(b.find_left(3), b.end_left());
+  EXPECT_THROW(b.at_right("three"), std::out_of_range);
+  EXPECT_EQ(*b.least_recent(), 1);
+  EXPECT_TRUE(b.erase_right("one"));
+  EXPECT_EQ(*b.least_recent(), 2);
+  std::vector<int> lefts(b.begin_left(), b.end_left());
+  EXPECT_EQ(lefts, (std::vector<int>{2, 4}));
+
+  lru_bimap<int, std::string> copy(b);
+  copy.insert(5, "five");
+  copy.insert(6, "six");
+  EXPECT_EQ(copy.find_left(2), copy.end_left());
+  EXPECT_NE(b.find_left(2), b.end_left());
+
+  lru_bimap<int, std::string> empty(0);
+  EXPECT_EQ(empty.insert(1, "one"), empty.end_left());
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(empty.least_recent(), empty.end_left());
+}
+
+using pmr_lru_bimap = lru_bimap<int, int, std::less<int>, std::less<int>,
+                                std::pmr::polymorphic_allocator<std::pair<int, int>>>;
+
+TEST(lru_bimap, no_allocations_when_full) {
+  counting_resource resource;
+  pmr_lru_bimap b(100, std::less<int>(), std::less<int>(), &resource);
+  for (int i = 0; i < 100; i++) {
+    b.insert(i, -i);
+  }
+  size_t after_fill = resource.allocations;
+  for (int i = 100; i < 10000; i++) {
+    b.insert(i, -i);
+    EXPECT_EQ(b.at_right(-(i - 1)), i - 1);
+  }
+  EXPECT_EQ(resource.allocations, after_fill);
+  EXPECT_EQ(b.size(), 100);
+
+  counting_resource other_resource;
+  pmr_lru_bimap other(10, std::less<int>(), std::less<int>(), &other_resource);
+  other = std::move(b);
+  EXPECT_EQ(other.size(), 100);
+  EXPECT_EQ(other.capacity(), 100);
+  int oldest = *other.least_recent();
+  other.insert(-1, 1);
+  EXPECT_EQ(other.find_left(oldest), other.end_left());
+  EXPECT_EQ(other.at_left(-1), 1);
+}
+
+TEST(lru_bimap_randomized, compare_to_list) {
+  lru_bimap<int, int> b(100);
+  // Пары от давних к свежим.
+  std::list<std::pair<int, int>> model;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 50000; i++) {
+    int l = e() % 300, r = e() % 300;
+    auto same_left = std::find_if(model.begin(), model.end(), [&](auto const &p) { return p.first == l; });
+    auto same_right = std::find_if(model.begin(), model.end(), [&](auto const &p) { return p.second == r; });
+    switch (e() % 4) {
+    case 0:
+    case 1: {
+      bool inserted = same_left == model.end() && same_right == model.end();
+      EXPECT_EQ(b.insert(l, r) != b.end_left(), inserted);
+      if (inserted) {
+        model.emplace_back(l, r);
+        if (model.size() > 100) {
+          model.pop_front();
+        }
+      }
+      break;
+    }
+    case 2:
+      EXPECT_EQ(b.find_left(l) != b.end_left(), same_left != model.end());
+      if (same_left != model.end()) {
+        EXPECT_EQ(b.at_left(l), same_left->second);
+        model.splice(model.end(), model, same_left);
+      }
+      break;
+    default:
+      EXPECT_EQ(b.erase_right(r), same_right != model.end());
+      if (same_right != model.end()) {
+        model.erase(same_right);
+      }
+    }
+    if (i % 1000 == 0) {
+      ASSERT_EQ(b.size(), model.size());
+      if (!model.empty()) {
+        EXPECT_EQ(*b.least_recent(), model.front().first);
+      }
+      lru_bimap<int, int> copy(b);
+      for (auto const &p : model) {
+        EXPECT_EQ(*copy.least_recent(), p.first);
+        copy.erase_left(copy.least_recent());
+      }
+      EXPECT_TRUE(copy.empty());
+    }
+  }
+}
+
+TEST(concurrent_bimap, simple) {
+  concurrent_bimap<int, std::string> b;
+  EXPECT_TRUE(b.empty());
+  EXPECT_TRUE(b.insert(1, "one"));
+  EXPECT_FALSE(b.insert(2, "one"));
+  b.update([](auto &m) {
+    m.insert(2, "two");
+    m.insert(3, "three");
+  });
+  EXPECT_EQ(b.size(), 3);
+  EXPECT_EQ(b.at_left(2), "two");
+  EXPECT_EQ(b.find_right("three"), 3);
+  EXPECT_EQ(b.find_left(4), std::nullopt);
+  EXPECT_THROW(b.at_right("four"), std::out_of_range);
+  EXPECT_TRUE(b.erase_right("one"));
+  EXPECT_FALSE(b.erase_left(1));
+  EXPECT_EQ(b.read([](auto const &s) { return *s.begin_left(); }), 2);
+
+  // Копия снимка переживает read и следующие изменения.
+  auto kept = b.read([](auto const &s) { return s; });
+  EXPECT_TRUE(b.insert(4, "four"));
+  EXPECT_EQ(kept.size(), 2);
+  EXPECT_EQ(kept.find_left(4), kept.end_left());
+  EXPECT_EQ(b.at_left(4), "four");
+
+  // Брошенный пакет не попадает ни в master, ни в следующий снимок.
+  EXPECT_THROW(b.update([](auto &m) {
+    m.insert(5, "five");
+    throw std::runtime_error("batch");
+  }), std::runtime_error);
+  EXPECT_TRUE(b.insert(6, "six"));
+  EXPECT_EQ(b.find_left(5), std::nullopt);
+  EXPECT_EQ(b.size(), 4);
+}
+
+TEST(concurrent_bimap, readers_see_whole_batches) {
+  concurrent_bimap<int, int> b;
+  b.update([](auto &m) {
+    for (int i = 0; i < 100; i++) {
+      m.insert(i, i);
+    }
+  });
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&] {
+      while (!done.load()) {
+        // Пакет меняет все пары разом: в снимке все right из одного раунда.
+        bool consistent = b.read([](auto const &s) {
+          int round = *s.begin_left().flip() / 1000;
+          for (auto it = s.begin_left(); it != s.end_left(); ++it) {
+            if (*it.flip() != round * 1000 + *it) {
+              return false;
+            }
+          }
+          return s.size() == 100;
+        });
+        EXPECT_TRUE(consistent);
+        auto right = b.find_left(50);
+        ASSERT_TRUE(right.has_value());
+        EXPECT_EQ(*right % 1000, 50);
+      }
+    });
+  }
+  for (int round = 1; round <= 200; round++) {
+    b.update([&](auto &m) {
+      m.clear();
+      for (int i = 0; i < 100; i++) {
+        m.insert(i, round * 1000 + i);
+      }
+    });
+  }
+  done.store(true);
+  for (auto &t : readers) {
+    t.join();
+  }
+  EXPECT_EQ(b.at_left(99), 200099);
+}
+
+TEST(persistent_bimap, snapshot_isolation) {
+  persistent_bimap<int, std::string> b;
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(b.insert(i, std::to_string(i)));
+  }
+  EXPECT_FALSE(b.insert(100, "5"));
+  auto snap = b.snapshot();
+  EXPECT_TRUE(b.erase_left(5));
+  EXPECT_TRUE(b.erase_right("6"));
+  EXPECT_TRUE(b.insert(5, "five"));
+  EXPECT_EQ(b.size(), 99);
+  EXPECT_EQ(snap.size(), 100);
+  EXPECT_EQ(b.at_left(5), "five");
+  EXPECT_EQ(snap.at_left(5), "5");
+  EXPECT_EQ(b.find_left(6), b.end_left());
+  EXPECT_EQ(*snap.find_left(6).flip(), "6");
+  EXPECT_THROW(b.at_right("6"), std::out_of_range);
+  // Неизменившиеся пары общие для версий.
+  EXPECT_EQ(&b.at_left(50), &snap.at_left(50));
+  EXPECT_NE(b, snap);
+
+  std::vector<int> lefts(snap.lower_bound_left(95), snap.end_left());
+  EXPECT_EQ(lefts, (std::vector<int>{95, 96, 97, 98, 99}));
+  EXPECT_EQ(*b.upper_bound_right("98"), "99");
+  EXPECT_EQ(*b.begin_right(), "0");
+
+  snap = b;
+  EXPECT_EQ(snap, b);
+  b.clear();
+  EXPECT_TRUE(b.empty());
+  EXPECT_EQ(snap.size(), 99);
+}
+
+TEST(persistent_bimap, move_only_keys) {
+  persistent_bimap<test_object, int, test_object_compare> b;
+  for (int i = 0; i < 10; i++) {
+    b.insert(test_object(i), i);
+  }
+  auto snap = b.snapshot();
+  b.erase_right(3);
+  b.insert(test_object(3), 30);
+  EXPECT_EQ(snap.at_right(3).a, 3);
+  EXPECT_EQ(b.at_right(30).a, 3);
+  EXPECT_EQ(b.find_right(3), b.end_right());
+}
+
+TEST(persistent_bimap, snapshot_read_while_writing) {
+  persistent_bimap<int, int> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i, -i);
+  }
+  auto snap = b.snapshot();
+  std::thread reader([&] {
+    for (int round = 0; round < 20; round++) {
+      int expected = 0;
+      for (auto it = snap.begin_left(); it != snap.end_left(); ++it, expected++) {
+        EXPECT_EQ(*it, expected);
+        EXPECT_EQ(snap.at_left(*it), -*it);
+      }
+      EXPECT_EQ(expected, 1000);
+    }
+  });
+  for (int i = 0; i < 1000; i++) {
+    b.erase_left(i);
+    b.insert(i, i + 1000);
+  }
+  reader.join();
+  EXPECT_EQ(b.at_right(1500), 500);
+}
+
+TEST(persistent_bimap_randomized, versions_compare_to_bimap) {
+  persistent_bimap<int, int> p;
+  bimap<int, int> b;
+  std::vector<std::pair<persistent_bimap<int, int>, bimap<int, int>>> versions;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 30000; i++) {
+    if (e() % 10 > 3 || b.empty()) {
+      int l = e() % 10000, r = e() % 10000;
+      EXPECT_EQ(p.insert(l, r), b.insert(l, r) != b.end_left());
+    } else {
+      auto it = b.lower_bound_left(e() % 10000);
+      if (it == b.end_left()) {
+        it = b.begin_left();
+      }
+      if (e() % 2 == 0) {
+        EXPECT_TRUE(p.erase_left(*it));
+      } else {
+        EXPECT_TRUE(p.erase_right(*it.flip()));
+      }
+      b.erase_left(it);
+    }
+    if (i % 1000 == 0) {
+      versions.emplace_back(p.snapshot(), b);
+    }
+  }
+  versions.emplace_back(p, b);
+  for (auto const &[snap, expected] : versions) {
+    ASSERT_EQ(snap.size(), expected.size());
+    EXPECT_TRUE(std::equal(expected.begin_left(), expected.end_left(), snap.begin_left(), snap.end_left()));
+    EXPECT_TRUE(std::equal(expected.begin_right(), expected.end_right(), snap.begin_right(), snap.end_right()));
+    for (auto it = expected.begin_left(); it != expected.end_left(); ++it) {
+      EXPECT_EQ(snap.at_left(*it), *it.flip());
+    }
+  }
+}
+
+TEST(sharded_bimap, simple) {
+  sharded_bimap<int, std::string> b(4);
+  EXPECT_TRUE(b.empty());
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(b.insert(i, std::to_string(i)));
+  }
+  EXPECT_FALSE(b.insert(5, "x"));
+  EXPECT_FALSE(b.insert(100, "5"));
+  EXPECT_EQ(b.size(), 100);
+  EXPECT_EQ(b.at_left(42), "42");
+  EXPECT_EQ(b.find_right("7"), 7);
+  EXPECT_EQ(b.find_left(100), std::nullopt);
+  EXPECT_THROW(b.at_right("x"), std::out_of_range);
+  EXPECT_TRUE(b.erase_left(5));
+  EXPECT_TRUE(b.erase_right("6"));
+  EXPECT_FALSE(b.erase_right("5"));
+  EXPECT_TRUE(b.insert(5, "6"));
+  EXPECT_EQ(b.size(), 99);
+
+  auto view = b.lock_all();
+  int expected = 0;
+  for (auto it = view.begin_left(); it != view.end_left(); ++it, expected++) {
+    if (expected == 6) {
+      expected++;
+    }
+    EXPECT_EQ(*it, expected);
+    EXPECT_EQ(it.partner(), expected == 5 ? "6" : std::to_string(expected));
+  }
+  EXPECT_EQ(expected, 100);
+  EXPECT_TRUE(std::is_sorted(view.begin_right(), view.end_right()));
+  EXPECT_EQ(std::distance(view.begin_right(), view.end_right()), 99);
+}
+
+TEST(sharded_bimap, concurrent_inserts_keep_sides_unique) {
+  sharded_bimap<int, int> b(8);
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; t++) {
+    writers.emplace_back([&b, t] {
+      std::mt19937 e(seed + t);
+      for (int i = 0; i < 20000; i++) {
+        int l = e() % 5000, r = e() % 5000;
+        if (e() % 4 == 0) {
+          if (e() % 2 == 0) {
+            b.erase_left(l);
+          } else {
+            b.erase_right(r);
+          }
+        } else {
+          b.insert(l, r);
+        }
+      }
+    });
+  }
+  for (auto &t : writers) {
+    t.join();
+  }
+  std::vector<std::pair<int, int>> pairs;
+  std::set<int> rights;
+  {
+    auto view = b.lock_all();
+    for (auto it = view.begin_left(); it != view.end_left(); ++it) {
+      pairs.emplace_back(*it, it.partner());
+      EXPECT_TRUE(rights.insert(it.partner()).second);
+    }
+    EXPECT_TRUE(std::equal(rights.begin(), rights.end(), view.begin_right(), view.end_right()));
+  }
+  EXPECT_EQ(pairs.size(), b.size());
+  for (auto const &[l, r] : pairs) {
+    EXPECT_EQ(b.at_right(r), l);
+  }
+}
+
+TEST(sharded_bimap_randomized, compare_to_bimap) {
+  sharded_bimap<int, int> s(5);
+  bimap<int, int> b;
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 30000; i++) {
+    int l = e() % 3000, r = e() % 3000;
+    switch (e() % 4) {
+    case 0:
+      EXPECT_EQ(s.erase_left(l), b.erase_left(l));
+      break;
+    case 1:
+      EXPECT_EQ(s.erase_right(r), b.erase_right(r));
+      break;
+    default:
+      EXPECT_EQ(s.insert(l, r), b.insert(l, r) != b.end_left());
+    }
+  }
+  ASSERT_EQ(s.size(), b.size());
+  auto view = s.lock_all();
+  EXPECT_TRUE(std::equal(b.begin_left(), b.end_left(), view.begin_left(), view.end_left()));
+  EXPECT_TRUE(std::equal(b.begin_right(), b.end_right(), view.begin_right(), view.end_right()));
+}
@@ -0,0 +1,435 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "frozen_bimap.h"
+
+// Двоичный формат bimap для ключей, которые можно копировать побайтно.
+// Файл -- заголовок и четыре массива, каждый выровнен на 64 байта:
+// ключи left по порядку, ранг партнера каждого left среди right,
+// ключи right по порядку, ранг партнера каждого right среди left.
+// Файл читается только на той же архитектуре: порядок байт, размеры
+// и выравнивания ключей записаны в заголовок и проверяются при открытии.
+struct mapped_bimap_header {
+    static constexpr char expected_magic[8] = {'B', 'I', 'M', 'A', 'P', '\0', '\0', '\0'};
+    static constexpr std::uint32_t current_version = 1;
+    static constexpr std::uint32_t native_byte_order = 0x01020304;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t left_size;
+    std::uint32_t left_align;
+    std::uint32_t right_size;
+    std::uint32_t right_align;
+    std::uint64_t count;
+    std::uint64_t left_keys;
+    std::uint64_t left_partner;
+    std::uint64_t right_keys;
+    std::uint64_t right_partner;
+    std::uint64_t file_size;
+
+    static constexpr std::uint64_t array_align = 64;
+
+    template<typename Left, typename Right>
+    static mapped_bimap_header describe(std::uint64_t count) noexcept {
+        mapped_bimap_header h{};
+        std::memcpy(h.magic, expected_magic, sizeof(h.magic));
+        h.version = current_version;
+        h.byte_order = native_byte_order;
+        h.left_size = sizeof(Left);
+        h.left_align = alignof(Left);
+        h.right_size = sizeof(Right);
+        h.right_align = alignof(Right);
+        h.count = count;
+        h.left_keys = align(sizeof(mapped_bimap_header));
+        h.left_partner = align(h.left_keys + count * sizeof(Left));
+        h.right_keys = align(h.left_partner + count * sizeof(std::uint64_t));
+        h.right_partner = align(h.right_keys + count * sizeof(Right));
+        h.file_size = h.right_partner + count * sizeof(std::uint64_t);
+        return h;
+    }
+
+    static std::uint64_t align(std::uint64_t offset) noexcept {
+        return (offset + array_align - 1) / array_align * array_align;
+    }
+};
+
+// Записывает упорядоченный bimap-подобный контейнер (bimap, frozen_bimap)
+// в файл path. Бросает std::system_error, если запись не удалась.
+template<typename Source>
+void save_bimap(Source const &source, const std::string &path) {
+    using left_t = typename Source::left_t;
+    using right_t = typename Source::right_t;
+    static_assert(std::is_trivially_copyable_v<left_t> && std::is_trivially_copyable_v<right_t>,
+                  "save_bimap: keys must be trivially copyable");
+
+    bimap_ranks<Source> ranks(source);
+    size_t n = ranks.lefts.size();
+    auto header = mapped_bimap_header::describe<left_t, right_t>(n);
+
+    // errno читается сразу после отказавшей операции, пока его не затерли
+    // следующие вызовы. Отказ без errno (например, tellp) -- EIO.
+    errno = 0;
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    auto check = [&] {
+        if (!out) {
+            int err = errno != 0 ? errno : EIO;
+            throw std::system_error(err, std::generic_category(), "save_bimap: " + path);
+        }
+    };
+    auto write = [&](const void *data, size_t size) {
+        out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        check();
+    };
+    auto pad_to = [&](std::uint64_t offset) {
+        static const char zeros[mapped_bimap_header::array_align] = {};
+        auto pos = out.tellp();
+        check();
+        write(zeros, offset - static_cast<std::uint64_t>(pos));
+    };
+    auto write_ranks = [&](std::vector<size_t> const &ranks_of) {
+        for (size_t r : ranks_of) {
+            auto value = static_cast<std::uint64_t>(r);
+            write(&value, sizeof(value));
+        }
+    };
+    check();
+    write(&header, sizeof(header));
+    pad_to(header.left_keys);
+    for (left_t const *key : ranks.lefts) {
+        write(key, sizeof(left_t));
+    }
+    pad_to(header.left_partner);
+    write_ranks(ranks.right_rank_of_left);
+    pad_to(header.right_keys);
+    for (right_t const *key : ranks.rights) {
+        write(key, sizeof(right_t));
+    }
+    pad_to(header.right_partner);
+    write_ranks(ranks.left_rank_of_right);
+    out.close();
+    check();
+}
+
+// bimap только для чтения поверх отображенного в память файла save_bimap.
+// Открытие проверяет заголовок и то, что ранги партнеров не выходят за
+// массивы, ключи не разбирает: поиск идет прямо по страницам файла,
+// и они подгружаются по мере обращения.
+// Компараторы должны совпадать с компараторами сохраненного bimap.
+template<typename Left, typename Right, typename CompareLeft = std::less<Left>,
+        typename CompareRight = std::less<Right>>
+struct mapped_bimap {
+    static_assert(std::is_trivially_copyable_v<Left> && std::is_trivially_copyable_v<Right>,
+                  "mapped_bimap: keys must be trivially copyable");
+
+    using left_t = Left;
+    using right_t = Right;
+
+    struct tag_key {
+    };
+    struct tag_value {
+    };
+
+private:
+    // Ранг k -- индекс в отсортированном массиве, count -- end().
+    template<typename T, typename Compare>
+    struct side_view : Compare {
+        const T *keys = nullptr;
+        const std::uint64_t *partner = nullptr;
+        size_t count = 0;
+
+        explicit side_view(const Compare &cmp) : Compare(cmp) {}
+
+        bool less(const T &a, const T &b) const {
+            return static_cast<const Compare &>(*this)(a, b);
+        }
+
+        // Бинарный поиск без ветвлений: сужаем [base, base + len) пополам.
+        template<typename Less>
+        size_t partition_point(Less go_right) const noexcept {
+            if (count == 0) {
+                return 0;
+            }
+            const T *base = keys;
+            size_t len = count;
+            while (len > 1) {
+                size_t half = len / 2;
+                base = go_right(base[half - 1]) ? base + half : base;
+                len -= half;
+            }
+            return static_cast<size_t>(base - keys) + static_cast<size_t>(go_right(*base));
+        }
+
+        size_t lower_bound(const T &val) const {
+            return partition_point([&](const T &key) { return less(key, val); });
+        }
+
+        size_t upper_bound(const T &val) const {
+            return partition_point([&](const T &key) { return !less(val, key); });
+        }
+
+        size_t find(const T &val) const {
+            size_t k = lower_bound(val);
+            return k != count && !less(val, keys[k]) ? k : count;
+        }
+
+        // Ранг партнера проверяется здесь, а не при открытии: испорченный
+        // ранг дает count (end), чтобы не читать за пределами отображения.
+        size_t partner_of(size_t k) const noexcept {
+            std::uint64_t r = partner[k];
+            return r < count ? static_cast<size_t>(r) : count;
+        }
+    };
+
+    void *mapping = MAP_FAILED;
+    size_t mapping_size = 0;
+    side_view<Left, CompareLeft> left_side;
+    side_view<Right, CompareRight> right_side;
+
+public:
+    template<typename side>
+    struct iterator {
+        using type = typename std::conditional<std::is_same_v<side, tag_key>, left_t, right_t>::type;
+        using inv_side = typename std::conditional<std::is_same_v<side, tag_key>, tag_value, tag_key>::type;
+
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = type const *;
+        using reference = type const &;
+
+        const mapped_bimap *owner;
+        size_t rank;
+
+        iterator(const mapped_bimap *owner, size_t rank) noexcept: owner(owner), rank(rank) {}
+
+        type const &operator*() const noexcept {
+            return array().keys[rank];
+        }
+
+        type const *operator->() const noexcept {
+            return &**this;
+        }
+
+        iterator &operator++() noexcept {
+            rank++;
+            return *this;
+        }
+
+        iterator operator++(int) noexcept {
+            iterator prev = *this;
+            ++*this;
+            return prev;
+        }
+
+        iterator &operator--() noexcept {
+            rank--;
+            return *this;
+        }
+
+        iterator operator--(int) noexcept {
+            iterator prev = *this;
+            --*this;
+            return prev;
+        }
+
+        friend bool operator==(iterator first, iterator second) noexcept {
+            return first.rank == second.rank;
+        }
+
+        friend bool operator!=(iterator first, iterator second) noexcept {
+            return first.rank != second.rank;
+        }
+
+        iterator<inv_side> flip() const noexcept {
+            return iterator<inv_side>(owner, array().partner_of(rank));
+        }
+
+    private:
+        auto const &array() const noexcept {
+            if constexpr (std::is_same_v<side, tag_key>) {
+                return owner->left_side;
+            } else {
+                return owner->right_side;
+            }
+        }
+    };
+
+    using left_iterator = iterator<tag_key>;
+    using right_iterator = iterator<tag_value>;
+
+    // Бросает std::system_error, если файл не открывается, и
+    // std::runtime_error, если он не в формате save_bimap для этих ключей.
+    explicit mapped_bimap(const std::string &path, CompareLeft compare_left = CompareLeft(),
+                          CompareRight compare_right = CompareRight())
+            : left_side(compare_left), right_side(compare_right) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "mapped_bimap: " + path);
+        }
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "mapped_bimap: " + path);
+        }
+        mapping_size = static_cast<size_t>(st.st_size);
+        if (mapping_size < sizeof(mapped_bimap_header)) {
+            ::close(fd);
+            throw std::runtime_error("mapped_bimap: " + path + " is too short");
+        }
+        mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+        int err = errno;
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::system_error(err, std::generic_category(), "mapped_bimap: " + path);
+        }
+
+        mapped_bimap_header header{};
+        std::memcpy(&header, mapping, sizeof(header));
+        // Каждая пара занимает в файле хотя бы байт: иначе расчет смещений переполнится.
+        auto expected = mapped_bimap_header::describe<Left, Right>(std::min<std::uint64_t>(header.count, mapping_size));
+        if (header.count > mapping_size || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+            header.version != expected.version || header.byte_order != expected.byte_order ||
+            header.left_size != expected.left_size || header.left_align != expected.left_align ||
+            header.right_size != expected.right_size || header.right_align != expected.right_align ||
+            header.left_keys != expected.left_keys || header.left_partner != expected.left_partner ||
+            header.right_keys != expected.right_keys || header.right_partner != expected.right_partner ||
+            header.file_size != expected.file_size || header.file_size != mapping_size) {
+            unmap();
+            throw std::runtime_error("mapped_bimap: " + path + " is not a bimap of these key types");
+        }
+
+        auto bytes = static_cast<const unsigned char *>(mapping);
+        size_t n = static_cast<size_t>(header.count);
+        left_side.keys = reinterpret_cast<const Left *>(bytes + header.left_keys);
+        left_side.partner = reinterpret_cast<const std::uint64_t *>(bytes + header.left_partner);
+        left_side.count = n;
+        right_side.keys = reinterpret_cast<const Right *>(bytes + header.right_keys);
+        right_side.partner = reinterpret_cast<const std::uint64_t *>(bytes + header.right_partner);
+        right_side.count = n;
+    }
+
+    mapped_bimap(mapped_bimap const &) = delete;
+
+    mapped_bimap &operator=(mapped_bimap const &) = delete;
+
+    mapped_bimap(mapped_bimap &&other) noexcept
+            : mapping(std::exchange(other.mapping, MAP_FAILED)), mapping_size(std::exchange(other.mapping_size, 0)),
+              left_side(other.left_side), right_side(other.right_side) {
+        other.left_side.count = 0;
+        other.right_side.count = 0;
+    }
+
+    mapped_bimap &operator=(mapped_bimap &&other) noexcept {
+        std::swap(mapping, other.mapping);
+        std::swap(mapping_size, other.mapping_size);
+        std::swap(left_side, other.left_side);
+        std::swap(right_side, other.right_side);
+        return *this;
+    }
+
+    ~mapped_bimap() {
+        unmap();
+    }
+
+    left_iterator find_left(left_t const &left) const {
+        return left_iterator(this, left_side.find(left));
+    }
+
+    right_iterator find_right(right_t const &right) const {
+        return right_iterator(this, right_side.find(right));
+    }
+
+    // Если элемента не существует -- бросает std::out_of_range,
+    // если ранг партнера в файле испорчен -- std::runtime_error.
+    right_t const &at_left(left_t const &key) const {
+        size_t k = left_side.find(key);
+        if (k == size()) {
+            throw std::out_of_range("mapped_bimap::at_left");
+        }
+        return right_side.keys[checked(left_side.partner_of(k))];
+    }
+
+    left_t const &at_right(right_t const &key) const {
+        size_t k = right_side.find(key);
+        if (k == size()) {
+            throw std::out_of_range("mapped_bimap::at_right");
+        }
+        return left_side.keys[checked(right_side.partner_of(k))];
+    }
+
+    left_iterator lower_bound_left(const left_t &left) const {
+        return left_iterator(this, left_side.lower_bound(left));
+    }
+
+    left_iterator upper_bound_left(const left_t &left) const {
+        return left_iterator(this, left_side.upper_bound(left));
+    }
+
+    right_iterator lower_bound_right(const right_t &right) const {
+        return right_iterator(this, right_side.lower_bound(right));
+    }
+
+    right_iterator upper_bound_right(const right_t &right) const {
+        return right_iterator(this, right_side.upper_bound(right));
+    }
+
+    left_iterator begin_left() const noexcept {
+        return left_iterator(this, 0);
+    }
+
+    left_iterator end_left() const noexcept {
+        return left_iterator(this, size());
+    }
+
+    right_iterator begin_right() const noexcept {
+        return right_iterator(this, 0);
+    }
+
+    right_iterator end_right() const noexcept {
+        return right_iterator(this, size());
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return size() == 0;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return left_side.count;
+    }
+
+private:
+    size_t checked(size_t partner) const {
+        if (partner == size()) {
+            throw std::runtime_error("mapped_bimap: partner rank out of range");
+        }
+        return partner;
+    }
+
+    void unmap() noexcept {
+        if (mapping != MAP_FAILED) {
+            ::munmap(mapping, mapping_size);
+            mapping = MAP_FAILED;
+        }
+    }
+};
@@ -0,0 +1,548 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Версионируемый bimap: копия и snapshot() стоят O(1), версии делят
+// неизменившиеся поддеревья. Узел treap'а, на который ссылается больше
+// одного родителя или корня, неизменяем: изменение версии копирует путь
+// от корня до места изменения, а узлы, которые видит только эта версия,
+// меняет на месте. Пара ключей хранится один раз на оба дерева и на все
+// версии. Узлы и пары считают ссылки и освобождаются вместе с последней
+// версией, которая их видит. Счетчики атомарные: разные версии можно читать
+// и менять из разных потоков, одну версию -- как обычный контейнер.
+// Итераторы однонаправленные, хранят путь от корня и инвалидируются любым
+// изменением своей версии.
+template<typename Left, typename Right, typename CompareLeft = std::less<Left>,
+        typename CompareRight = std::less<Right>>
+struct persistent_bimap {
+
+    using left_t = Left;
+    using right_t = Right;
+
+    struct tag_key {
+    };
+    struct tag_value {
+    };
+
+private:
+    // Приоритет один на пару: оба treap'а используют его.
+    struct pair_data {
+        std::atomic<size_t> refs{1};
+        std::uint32_t priority;
+        Left left;
+        Right right;
+
+        template<typename L, typename R>
+        pair_data(std::uint32_t priority, L &&left, R &&right)
+                : priority(priority), left(std::forward<L>(left)), right(std::forward<R>(right)) {}
+    };
+
+    // refs -- число родителей и корней версий, указывающих на узел.
+    struct node {
+        std::atomic<size_t> refs{1};
+        node *left = nullptr;
+        node *right = nullptr;
+        pair_data *pair;
+
+        explicit node(pair_data *pair) noexcept: pair(pair) {}
+
+        // Копия для изменения: те же пара и дети, на них ссылок становится больше.
+        explicit node(node const &other) noexcept: left(share(other.left)), right(share(other.right)),
+                                                   pair(other.pair) {
+            pair->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::uint32_t priority() const noexcept {
+            return pair->priority;
+        }
+    };
+
+    static node *share(node *n) noexcept {
+        if (n != nullptr) {
+            n->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    static void release(node *n) noexcept {
+        while (n != nullptr && n->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release(n->left);
+            if (n->pair->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete n->pair;
+            }
+            delete std::exchange(n, n->right);
+        }
+    }
+
+    // Делает узел в slot собственным для этой версии. Копия создается до
+    // того, как отпускается оригинал, так что при bad_alloc дерево цело.
+    static void unshare(node *&slot) {
+        if (slot->refs.load(std::memory_order_acquire) != 1) {
+            release(std::exchange(slot, new node(*slot)));
+        }
+    }
+
+    template<typename side, typename Compare>
+    struct tree : Compare {
+        using type = std::conditional_t<std::is_same_v<side, tag_key>, left_t, right_t>;
+
+        node *root = nullptr;
+
+        explicit tree(Compare const &cmp) : Compare(cmp) {}
+
+        static type const &key(node const *n) noexcept {
+            if constexpr (std::is_same_v<side, tag_key>) {
+                return n->pair->left;
+            } else {
+                return n->pair->right;
+            }
+        }
+
+        template<typename A, typename B>
+        bool less(A const &a, B const &b) const {
+            return Compare::operator()(a, b);
+        }
+
+        node *find(type const &val) const {
+            node *cur = root;
+            while (cur != nullptr) {
+                if (less(val, key(cur))) {
+                    cur = cur->left;
+                } else if (less(key(cur), val)) {
+                    cur = cur->right;
+                } else {
+                    return cur;
+                }
+            }
+            return nullptr;
+        }
+
+        // Копирует путь поиска val, а если val найден -- еще и пути к его
+        // соседям внутри поддерева. Это ровно те узлы, которые меняют
+        // split/insert/erase по val, поэтому дальше они идут без аллокаций.
+        void own_path(type const &val) {
+            node **slot = &root;
+            while (*slot != nullptr) {
+                unshare(*slot);
+                node *n = *slot;
+                if (less(val, key(n))) {
+                    slot = &n->left;
+                } else if (less(key(n), val)) {
+                    slot = &n->right;
+                } else {
+                    for (node **s = &n->left; *s != nullptr; s = &(*s)->right) {
+                        unshare(*s);
+                    }
+                    for (node **s = &n->right; *s != nullptr; s = &(*s)->left) {
+                        unshare(*s);
+                    }
+                    return;
+                }
+            }
+        }
+
+        // Ниже узлы на путях уже собственные (см. own_path).
+        void split(node *t, type const &val, node *&l, node *&r) const noexcept {
+            node **l_slot = &l;
+            node **r_slot = &r;
+            while (t != nullptr) {
+                if (less(key(t), val)) {
+                    *l_slot = t;
+                    l_slot = &t->right;
+                    t = t->right;
+                } else {
+                    *r_slot = t;
+                    r_slot = &t->left;
+                    t = t->left;
+                }
+            }
+            *l_slot = *r_slot = nullptr;
+        }
+
+        static node *merge(node *a, node *b) noexcept {
+            node *res;
+            node **slot = &res;
+            while (a != nullptr && b != nullptr) {
+                if (a->priority() >= b->priority()) {
+                    *slot = a;
+                    slot = &a->right;
+                    a = a->right;
+                } else {
+                    *slot = b;
+                    slot = &b->left;
+                    b = b->left;
+                }
+            }
+            *slot = a != nullptr ? a : b;
+            return res;
+        }
+
+        void insert(node *n) noexcept {
+            node **slot = &root;
+            while (*slot != nullptr && (*slot)->priority() >= n->priority()) {
+                slot = less(key(n), key(*slot)) ? &(*slot)->left : &(*slot)->right;
+            }
+            split(*slot, key(n), n->left, n->right);
+            *slot = n;
+        }
+
+        void erase(type const &val) noexcept {
+            node **slot = &root;
+            while (less(val, key(*slot)) || less(key(*slot), val)) {
+                slot = less(val, key(*slot)) ? &(*slot)->left : &(*slot)->right;
+            }
+            node *victim = *slot;
+            *slot = merge(std::exchange(victim->left, nullptr), std::exchange(victim->right, nullptr));
+            release(victim);
+        }
+    };
+
+    template<typename side>
+    using tree_t = std::conditional_t<std::is_same_v<side, tag_key>, tree<tag_key, CompareLeft>,
+            tree<tag_value, CompareRight>>;
+
+    tree_t<tag_key> left_tree;
+    tree_t<tag_value> right_tree;
+    size_t pair_count = 0;
+    std::uint64_t priority_state;
+
+    template<typename side>
+    tree_t<side> const &get_tree() const noexcept {
+        if constexpr (std::is_same_v<side, tag_key>) {
+            return left_tree;
+        } else {
+            return right_tree;
+        }
+    }
+
+public:
+    template<typename side>
+    struct iterator {
+        using type = typename tree_t<side>::type;
+        using inv_side = std::conditional_t<std::is_same_v<side, tag_key>, tag_value, tag_key>;
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = type const *;
+        using reference = type const &;
+
+        iterator() = default;
+
+        type const &operator*() const noexcept {
+            return tree_t<side>::key(path.back());
+        }
+
+        type const *operator->() const noexcept {
+            return &**this;
+        }
+
+        // Наверху стека текущий узел, под ним -- предки, до которых обход
+        // еще не дошел.
+        iterator &operator++() {
+            node const *cur = path.back();
+            path.pop_back();
+            for (cur = cur->right; cur != nullptr; cur = cur->left) {
+                path.push_back(cur);
+            }
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator prev = *this;
+            ++*this;
+            return prev;
+        }
+
+        friend bool operator==(iterator const &first, iterator const &second) noexcept {
+            return first.current() == second.current();
+        }
+
+        friend bool operator!=(iterator const &first, iterator const &second) noexcept {
+            return first.current() != second.current();
+        }
+
+        // Для end() не определен. Путь в другом дереве ищется заново, O(log n).
+        iterator<inv_side> flip() const {
+            return owner->template find<inv_side>(tree_t<inv_side>::key(path.back()));
+        }
+
+    private:
+        friend struct persistent_bimap;
+
+        persistent_bimap const *owner = nullptr;
+        std::vector<node const *> path;
+
+        explicit iterator(persistent_bimap const *owner) noexcept: owner(owner) {}
+
+        node const *current() const noexcept {
+            return path.empty() ? nullptr : path.back();
+        }
+    };
+
+    using left_iterator = iterator<tag_key>;
+    using right_iterator = iterator<tag_value>;
+
+    explicit persistent_bimap(CompareLeft compare_left = CompareLeft(), CompareRight compare_right = CompareRight())
+            : left_tree(compare_left), right_tree(compare_right),
+              priority_state(reinterpret_cast<std::uintptr_t>(this) * 0x9E3779B97F4A7C15ULL | 1) {}
+
+    // O(1): версии делят все узлы, пока одна из них не изменится.
+    persistent_bimap(persistent_bimap const &other)
+            : left_tree(other.left_tree), right_tree(other.right_tree), pair_count(other.pair_count),
+              priority_state(other.priority_state) {
+        share(left_tree.root);
+        share(right_tree.root);
+    }
+
+    persistent_bimap(persistent_bimap &&other) noexcept
+            : left_tree(other.left_tree), right_tree(other.right_tree),
+              pair_count(std::exchange(other.pair_count, 0)), priority_state(other.priority_state) {
+        other.left_tree.root = nullptr;
+        other.right_tree.root = nullptr;
+    }
+
+    persistent_bimap &operator=(persistent_bimap other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~persistent_bimap() {
+        release(left_tree.root);
+        release(right_tree.root);
+    }
+
+    void swap(persistent_bimap &other) noexcept {
+        std::swap(left_tree, other.left_tree);
+        std::swap(right_tree, other.right_tree);
+        std::swap(pair_count, other.pair_count);
+        std::swap(priority_state, other.priority_state);
+    }
+
+    // Неизменяемая точка во времени, дальнейшие изменения этой версии ее не трогают.
+    persistent_bimap snapshot() const {
+        return *this;
+    }
+
+    // Вставка пары, если ни left, ни right еще нет. Копирует пути поиска
+    // обоих ключей, если они общие с другими версиями.
+    template<typename L, typename R>
+    bool insert(L &&left, R &&right) {
+        if constexpr (std::is_same_v<std::decay_t<L>, left_t> && std::is_same_v<std::decay_t<R>, right_t>) {
+            if (left_tree.find(left) != nullptr || right_tree.find(right) != nullptr) {
+                return false;
+            }
+            auto pair = new pair_data(next_priority(), std::forward<L>(left), std::forward<R>(right));
+            pair->refs.store(2, std::memory_order_relaxed);
+            node *left_node = new node(pair);
+            node *right_node = nullptr;
+            try {
+                right_node = new node(pair);
+                left_tree.own_path(pair->left);
+                right_tree.own_path(pair->right);
+            } catch (...) {
+                delete right_node;
+                delete left_node;
+                delete pair;
+                throw;
+            }
+            left_tree.insert(left_node);
+            right_tree.insert(right_node);
+            pair_count++;
+            return true;
+        } else {
+            return insert(left_t(std::forward<L>(left)), right_t(std::forward<R>(right)));
+        }
+    }
+
+    // Удаляет пару по ключу, возвращает была ли пара удалена.
+    bool erase_left(left_t const &left) {
+        node *n = left_tree.find(left);
+        if (n == nullptr) {
+            return false;
+        }
+        erase_pair(n->pair);
+        return true;
+    }
+
+    bool erase_right(right_t const &right) {
+        node *n = right_tree.find(right);
+        if (n == nullptr) {
+            return false;
+        }
+        erase_pair(n->pair);
+        return true;
+    }
+
+    void clear() noexcept {
+        release(std::exchange(left_tree.root, nullptr));
+        release(std::exchange(right_tree.root, nullptr));
+        pair_count = 0;
+    }
+
+    left_iterator find_left(left_t const &left) const {
+        return find<tag_key>(left);
+    }
+
+    right_iterator find_right(right_t const &right) const {
+        return find<tag_value>(right);
+    }
+
+    // Ссылка живет, пока пара есть хотя бы в одной версии.
+    // Если элемента не существует -- бросает std::out_of_range.
+    right_t const &at_left(left_t const &key) const {
+        node *n = left_tree.find(key);
+        if (n == nullptr) {
+            throw std::out_of_range("persistent_bimap::at_left");
+        }
+        return n->pair->right;
+    }
+
+    left_t const &at_right(right_t const &key) const {
+        node *n = right_tree.find(key);
+        if (n == nullptr) {
+            throw std::out_of_range("persistent_bimap::at_right");
+        }
+        return n->pair->left;
+    }
+
+    // Как at_*, но без исключения и без итератора: nullptr, если элемента нет.
+    right_t const *try_at_left(left_t const &key) const {
+        node *n = left_tree.find(key);
+        return n == nullptr ? nullptr : &n->pair->right;
+    }
+
+    left_t const *try_at_right(right_t const &key) const {
+        node *n = right_tree.find(key);
+        return n == nullptr ? nullptr : &n->pair->left;
+    }
+
+    left_iterator lower_bound_left(left_t const &left) const {
+        return bound<tag_key>(left, false);
+    }
+
+    left_iterator upper_bound_left(left_t const &left) const {
+        return bound<tag_key>(left, true);
+    }
+
+    right_iterator lower_bound_right(right_t const &right) const {
+        return bound<tag_value>(right, false);
+    }
+
+    right_iterator upper_bound_right(right_t const &right) const {
+        return bound<tag_value>(right, true);
+    }
+
+    left_iterator begin_left() const {
+        return leftmost<tag_key>();
+    }
+
+    left_iterator end_left() const noexcept {
+        return left_iterator(this);
+    }
+
+    right_iterator begin_right() const {
+        return leftmost<tag_value>();
+    }
+
+    right_iterator end_right() const noexcept {
+        return right_iterator(this);
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return pair_count == 0;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return pair_count;
+    }
+
+private:
+    std::uint32_t next_priority() noexcept {
+        priority_state ^= priority_state >> 12;
+        priority_state ^= priority_state << 25;
+        priority_state ^= priority_state >> 27;
+        return static_cast<std::uint32_t>((priority_state * 0x2545F4914F6CDD1DULL) >> 32);
+    }
+
+    // Пара держится лишней ссылкой: own_path может освободить узел, через
+    // который ее нашли, а ключи пары нужны до конца удаления.
+    void erase_pair(pair_data *pair) {
+        pair->refs.fetch_add(1, std::memory_order_relaxed);
+        try {
+            left_tree.own_path(pair->left);
+            right_tree.own_path(pair->right);
+        } catch (...) {
+            pair->refs.fetch_sub(1, std::memory_order_relaxed);
+            throw;
+        }
+        left_tree.erase(pair->left);
+        right_tree.erase(pair->right);
+        pair_count--;
+        if (pair->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete pair;
+        }
+    }
+
+    template<typename side>
+    iterator<side> leftmost() const {
+        iterator<side> res(this);
+        for (node const *cur = get_tree<side>().root; cur != nullptr; cur = cur->left) {
+            res.path.push_back(cur);
+        }
+        return res;
+    }
+
+    // Первый элемент не меньше val (strict -- больше val).
+    template<typename side>
+    iterator<side> bound(typename tree_t<side>::type const &val, bool strict) const {
+        auto const &t = get_tree<side>();
+        iterator<side> res(this);
+        for (node const *cur = t.root; cur != nullptr;) {
+            if (strict ? t.less(val, t.key(cur)) : !t.less(t.key(cur), val)) {
+                res.path.push_back(cur);
+                cur = cur->left;
+            } else {
+                cur = cur->right;
+            }
+        }
+        return res;
+    }
+
+    template<typename side>
+    iterator<side> find(typename tree_t<side>::type const &val) const {
+        auto res = bound<side>(val, false);
+        if (!res.path.empty() && get_tree<side>().less(val, *res)) {
+            res.path.clear();
+        }
+        return res;
+    }
+};
+
+template<typename Left, typename Right, typename CompareLeft, typename CompareRight>
+bool operator==(persistent_bimap<Left, Right, CompareLeft, CompareRight> const &a,
+                persistent_bimap<Left, Right, CompareLeft, CompareRight> const &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (auto it_a = a.begin_left(), it_b = b.begin_left(); it_a != a.end_left(); ++it_a, ++it_b) {
+        if (*it_a != *it_b || a.at_left(*it_a) != b.at_left(*it_b)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Left, typename Right, typename CompareLeft, typename CompareRight>
+bool operator!=(persistent_bimap<Left, Right, CompareLeft, CompareRight> const &a,
+                persistent_bimap<Left, Right, CompareLeft, CompareRight> const &b) {
+    return !(a == b);
+}
@@ -0,0 +1,423 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bimap.h"
+
+// bimap, разбитый на шарды под отдельными мьютексами, для многопоточных
+// вставок. Пара лежит в шарде своего left (по хешу) и в шарде своего right,
+// если это другой шард: поиск по любой стороне идет в один шард. Изменение
+// пары берет не больше двух мьютексов, всегда в порядке номеров шардов,
+// поэтому операции над разными шардами идут параллельно и не блокируют
+// друг друга навечно. Ценой уникальности обеих сторон без общего замка
+// большинство пар хранится дважды.
+template<typename Left, typename Right, typename CompareLeft = std::less<Left>,
+        typename CompareRight = std::less<Right>, typename HashLeft = std::hash<Left>,
+        typename HashRight = std::hash<Right>>
+struct sharded_bimap {
+    using left_t = Left;
+    using right_t = Right;
+    using map_type = bimap<Left, Right, CompareLeft, CompareRight>;
+    using tag_key = typename map_type::tag_key;
+    using tag_value = typename map_type::tag_value;
+
+    static constexpr size_t default_shards = 16;
+
+private:
+    struct alignas(64) shard {
+        mutable std::mutex lock;
+        map_type map;
+
+        shard(CompareLeft const &compare_left, CompareRight const &compare_right)
+                : map(compare_left, compare_right) {}
+    };
+
+    std::vector<std::unique_ptr<shard>> shards;
+    std::atomic<size_t> pair_count{0};
+    CompareLeft compare_left;
+    CompareRight compare_right;
+    HashLeft hash_left;
+    HashRight hash_right;
+
+public:
+    explicit sharded_bimap(size_t shard_count = default_shards, CompareLeft compare_left = CompareLeft(),
+                           CompareRight compare_right = CompareRight(), HashLeft hash_left = HashLeft(),
+                           HashRight hash_right = HashRight())
+            : compare_left(std::move(compare_left)), compare_right(std::move(compare_right)),
+              hash_left(std::move(hash_left)), hash_right(std::move(hash_right)) {
+        if (shard_count == 0) {
+            throw std::invalid_argument("sharded_bimap: no shards");
+        }
+        shards.reserve(shard_count);
+        for (size_t i = 0; i < shard_count; i++) {
+            shards.push_back(std::make_unique<shard>(this->compare_left, this->compare_right));
+        }
+    }
+
+    sharded_bimap(sharded_bimap const &) = delete;
+
+    sharded_bimap &operator=(sharded_bimap const &) = delete;
+
+    // Вставка пары, если ни left, ни right еще нет.
+    template<typename L, typename R>
+    bool insert(L &&left, R &&right) {
+        if constexpr (std::is_same_v<std::decay_t<L>, left_t> && std::is_same_v<std::decay_t<R>, right_t>) {
+            size_t a = left_shard(left);
+            size_t b = right_shard(right);
+            auto locks = lock_two(a, b);
+            map_type &in_a = shards[a]->map;
+            map_type &in_b = shards[b]->map;
+            if (in_a.find_left(left) != in_a.end_left() || in_b.find_right(right) != in_b.end_right()) {
+                return false;
+            }
+            if (a == b) {
+                in_a.emplace(std::forward<L>(left), std::forward<R>(right));
+            } else {
+                in_a.insert(left, right);
+                try {
+                    in_b.emplace(std::forward<L>(left), std::forward<R>(right));
+                } catch (...) {
+                    in_a.erase_left(left);
+                    throw;
+                }
+            }
+            pair_count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        } else {
+            return insert(left_t(std::forward<L>(left)), right_t(std::forward<R>(right)));
+        }
+    }
+
+    // Удаляет пару по ключу, возвращает была ли пара удалена.
+    bool erase_left(left_t const &left) {
+        return erase_key<tag_key>(left);
+    }
+
+    bool erase_right(right_t const &right) {
+        return erase_key<tag_value>(right);
+    }
+
+    // Парный элемент по копии: после выхода из функции шард уже не заблокирован.
+    std::optional<right_t> find_left(left_t const &left) const {
+        shard const &s = *shards[left_shard(left)];
+        std::lock_guard<std::mutex> guard(s.lock);
+        auto it = s.map.find_left(left);
+        if (it == s.map.end_left()) {
+            return std::nullopt;
+        }
+        return *it.flip();
+    }
+
+    std::optional<left_t> find_right(right_t const &right) const {
+        shard const &s = *shards[right_shard(right)];
+        std::lock_guard<std::mutex> guard(s.lock);
+        auto it = s.map.find_right(right);
+        if (it == s.map.end_right()) {
+            return std::nullopt;
+        }
+        return *it.flip();
+    }
+
+    // Если элемента не существует -- бросает std::out_of_range.
+    right_t at_left(left_t const &key) const {
+        shard const &s = *shards[left_shard(key)];
+        std::lock_guard<std::mutex> guard(s.lock);
+        return s.map.at_left(key);
+    }
+
+    left_t at_right(right_t const &key) const {
+        shard const &s = *shards[right_shard(key)];
+        std::lock_guard<std::mutex> guard(s.lock);
+        return s.map.at_right(key);
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return pair_count.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return size() == 0;
+    }
+
+    [[nodiscard]] size_t shard_count() const noexcept {
+        return shards.size();
+    }
+
+    // Обход одной стороны по порядку: слияние обходов шардов, в каждом
+    // шарде берутся только пары, для которых он -- шард этой стороны.
+    template<typename side>
+    struct ordered_iterator {
+        using shard_iterator = typename map_type::template iterator<side>;
+        using type = typename shard_iterator::type;
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = type const *;
+        using reference = type const &;
+
+        type const &operator*() const noexcept {
+            return *heads.front().cur;
+        }
+
+        type const *operator->() const noexcept {
+            return &**this;
+        }
+
+        // Парный элемент текущей пары.
+        auto const &partner() const noexcept {
+            return *heads.front().cur.flip();
+        }
+
+        ordered_iterator &operator++() {
+            std::pop_heap(heads.begin(), heads.end(), later{owner});
+            heads.back().advance(owner);
+            if (heads.back().cur == heads.back().end) {
+                heads.pop_back();
+            } else {
+                std::push_heap(heads.begin(), heads.end(), later{owner});
+            }
+            return *this;
+        }
+
+        ordered_iterator operator++(int) {
+            ordered_iterator prev = *this;
+            ++*this;
+            return prev;
+        }
+
+        friend bool operator==(ordered_iterator const &first, ordered_iterator const &second) noexcept {
+            if (first.heads.empty() || second.heads.empty()) {
+                return first.heads.empty() == second.heads.empty();
+            }
+            return first.heads.front().cur == second.heads.front().cur;
+        }
+
+        friend bool operator!=(ordered_iterator const &first, ordered_iterator const &second) noexcept {
+            return !(first == second);
+        }
+
+    private:
+        friend struct sharded_bimap;
+
+        struct head {
+            shard_iterator cur;
+            shard_iterator end;
+            size_t index;
+
+            // До следующей пары, принадлежащей этому шарду по стороне side.
+            void skip_foreign(sharded_bimap const *owner) {
+                while (cur != end && owner->template shard_of<side>(*cur) != index) {
+                    ++cur;
+                }
+            }
+
+            void advance(sharded_bimap const *owner) {
+                ++cur;
+                skip_foreign(owner);
+            }
+        };
+
+        // Для кучи с минимумом наверху.
+        struct later {
+            sharded_bimap const *owner;
+
+            bool operator()(head const &a, head const &b) const {
+                return owner->template less<side>(*b.cur, *a.cur);
+            }
+        };
+
+        sharded_bimap const *owner = nullptr;
+        std::vector<head> heads;
+
+        explicit ordered_iterator(sharded_bimap const *owner) noexcept: owner(owner) {}
+    };
+
+    using left_iterator = ordered_iterator<tag_key>;
+    using right_iterator = ordered_iterator<tag_value>;
+
+    // Все шарды под замками, взятыми по порядку номеров: пока вид жив,
+    // содержимое не меняется. Менять bimap из потока, держащего вид, нельзя.
+    struct locked_view {
+        left_iterator begin_left() const {
+            return owner->template merged_begin<tag_key>();
+        }
+
+        left_iterator end_left() const noexcept {
+            return left_iterator(owner);
+        }
+
+        right_iterator begin_right() const {
+            return owner->template merged_begin<tag_value>();
+        }
+
+        right_iterator end_right() const noexcept {
+            return right_iterator(owner);
+        }
+
+    private:
+        friend struct sharded_bimap;
+
+        sharded_bimap const *owner;
+        std::vector<std::unique_lock<std::mutex>> locks;
+
+        explicit locked_view(sharded_bimap const *owner) : owner(owner) {
+            locks.reserve(owner->shards.size());
+            for (auto const &s : owner->shards) {
+                locks.emplace_back(s->lock);
+            }
+        }
+    };
+
+    locked_view lock_all() const {
+        return locked_view(this);
+    }
+
+private:
+    static size_t mix(size_t h) noexcept {
+        std::uint64_t x = static_cast<std::uint64_t>(h) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(x ^ (x >> 32));
+    }
+
+    size_t left_shard(left_t const &left) const {
+        return mix(hash_left(left)) % shards.size();
+    }
+
+    size_t right_shard(right_t const &right) const {
+        return mix(hash_right(right)) % shards.size();
+    }
+
+    template<typename side, typename K>
+    size_t shard_of(K const &key) const {
+        if constexpr (std::is_same_v<side, tag_key>) {
+            return left_shard(key);
+        } else {
+            return right_shard(key);
+        }
+    }
+
+    template<typename side, typename K>
+    bool less(K const &a, K const &b) const {
+        if constexpr (std::is_same_v<side, tag_key>) {
+            return compare_left(a, b);
+        } else {
+            return compare_right(a, b);
+        }
+    }
+
+    // Мьютексы шардов a и b по возрастанию номеров, один, если a == b.
+    std::pair<std::unique_lock<std::mutex>, std::unique_lock<std::mutex>> lock_two(size_t a, size_t b) const {
+        if (a > b) {
+            std::swap(a, b);
+        }
+        std::unique_lock<std::mutex> first(shards[a]->lock);
+        if (a == b) {
+            return {std::move(first), std::unique_lock<std::mutex>()};
+        }
+        return {std::move(first), std::unique_lock<std::mutex>(shards[b]->lock)};
+    }
+
+    template<typename side, typename K>
+    static auto find_in(map_type &map, K const &key) {
+        if constexpr (std::is_same_v<side, tag_key>) {
+            return std::make_pair(map.find_left(key), map.end_left());
+        } else {
+            return std::make_pair(map.find_right(key), map.end_right());
+        }
+    }
+
+    // Шард ключа известен сразу, шард партнера -- только после поиска под
+    // замком. Если партнер в шарде с меньшим номером, замок отпускается и
+    // оба берутся заново по порядку; пара за это время могла смениться,
+    // тогда попытка повторяется.
+    template<typename side, typename K>
+    bool erase_key(K const &key) {
+        size_t a = shard_of<side>(key);
+        for (;;) {
+            std::unique_lock<std::mutex> first(shards[a]->lock);
+            auto [it, end] = find_in<side>(shards[a]->map, key);
+            if (it == end) {
+                return false;
+            }
+            size_t b = partner_shard<side>(it);
+            if (b >= a) {
+                std::unique_lock<std::mutex> second;
+                if (b > a) {
+                    second = std::unique_lock<std::mutex>(shards[b]->lock);
+                }
+                erase_pair<side>(a, b, it, key);
+                return true;
+            }
+            first.unlock();
+            auto locks = lock_two(a, b);
+            std::tie(it, end) = find_in<side>(shards[a]->map, key);
+            if (it == end) {
+                return false;
+            }
+            if (partner_shard<side>(it) == b) {
+                erase_pair<side>(a, b, it, key);
+                return true;
+            }
+        }
+    }
+
+    template<typename side, typename It>
+    size_t partner_shard(It it) const {
+        if constexpr (std::is_same_v<side, tag_key>) {
+            return right_shard(*it.flip());
+        } else {
+            return left_shard(*it.flip());
+        }
+    }
+
+    // Оба шарда под замками; it -- пара в шарде a, найденная по key.
+    template<typename side, typename It, typename K>
+    void erase_pair(size_t a, size_t b, It it, K const &key) {
+        if constexpr (std::is_same_v<side, tag_key>) {
+            if (a != b) {
+                shards[b]->map.erase_left(key);
+            }
+            shards[a]->map.erase_left(it);
+        } else {
+            if (a != b) {
+                shards[b]->map.erase_right(key);
+            }
+            shards[a]->map.erase_right(it);
+        }
+        pair_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    template<typename side>
+    ordered_iterator<side> merged_begin() const {
+        ordered_iterator<side> res(this);
+        for (size_t i = 0; i < shards.size(); i++) {
+            map_type const &map = shards[i]->map;
+            typename ordered_iterator<side>::head h = [&] {
+                if constexpr (std::is_same_v<side, tag_key>) {
+                    return typename ordered_iterator<side>::head{map.begin_left(), map.end_left(), i};
+                } else {
+                    return typename ordered_iterator<side>::head{map.begin_right(), map.end_right(), i};
+                }
+            }();
+            h.skip_foreign(this);
+            if (h.cur != h.end) {
+                res.heads.push_back(h);
+            }
+        }
+        std::make_heap(res.heads.begin(), res.heads.end(), typename ordered_iterator<side>::later{this});
+        return res;
+    }
+};
@@ -0,0 +1,453 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dense_store.h"
+
+// bimap без порядка: поиск по обеим сторонам через хеш-таблицы.
+// Пары лежат подряд в одном хранилище, две таблицы с открытой адресацией
+// (линейное пробирование) хранят индексы пар в нем. Удаление переносит
+// последнюю пару на место удаленной, поэтому порядок обхода произвольный
+// и меняется при удалениях. Обход идет от последней добавленной пары к первой:
+// end() не зависит от размера и не сдвигается при вставке.
+template<typename Left, typename Right, typename HashLeft = std::hash<Left>,
+        typename HashRight = std::hash<Right>, typename EqualLeft = std::equal_to<Left>,
+        typename EqualRight = std::equal_to<Right>>
+struct unordered_bimap {
+
+    using left_t = Left;
+    using right_t = Right;
+
+    struct tag_key {
+    };
+    struct tag_value {
+    };
+
+private:
+    struct entry {
+        Left left;
+        Right right;
+    };
+
+    using pair_store = dense_store<entry>;
+
+    static constexpr size_t empty_slot = SIZE_MAX;
+
+    struct slot {
+        size_t index = empty_slot;
+        size_t hash = 0;
+    };
+
+    // Таблица индексов одной стороны. Удаление сдвигает следующие элементы
+    // цепочки назад, поэтому надгробия не нужны.
+    template<typename T, typename Hash, typename Equal, T entry::*key>
+    struct index_table : Hash, Equal {
+        std::vector<slot> slots;
+        size_t shift = 64;
+
+        index_table(const Hash &hash, const Equal &equal) : Hash(hash), Equal(equal) {}
+
+        size_t hash_of(const T &val) const {
+            return static_cast<const Hash &>(*this)(val);
+        }
+
+        bool equal(const T &a, const T &b) const {
+            return static_cast<const Equal &>(*this)(a, b);
+        }
+
+        // Фибоначчиево хеширование: std::hash для чисел -- тождественная функция.
+        size_t home(size_t hash) const noexcept {
+            return static_cast<size_t>((static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >> shift);
+        }
+
+        size_t mask() const noexcept {
+            return slots.size() - 1;
+        }
+
+        // Индекс пары с ключом val или empty_slot.
+        size_t find(const pair_store &store, const T &val, size_t hash) const {
+            if (slots.empty()) {
+                return empty_slot;
+            }
+            for (size_t i = home(hash);; i = (i + 1) & mask()) {
+                const slot &s = slots[i];
+                if (s.index == empty_slot) {
+                    return empty_slot;
+                }
+                if (s.hash == hash && equal(store.data[s.index].*key, val)) {
+                    return s.index;
+                }
+            }
+        }
+
+        void insert(size_t index, size_t hash) noexcept {
+            size_t i = home(hash);
+            while (slots[i].index != empty_slot) {
+                i = (i + 1) & mask();
+            }
+            slots[i] = {index, hash};
+        }
+
+        size_t position_of(size_t index, size_t hash) const noexcept {
+            size_t i = home(hash);
+            while (slots[i].index != index) {
+                i = (i + 1) & mask();
+            }
+            return i;
+        }
+
+        void erase(size_t index, size_t hash) noexcept {
+            size_t hole = position_of(index, hash);
+            for (size_t j = (hole + 1) & mask(); slots[j].index != empty_slot; j = (j + 1) & mask()) {
+                size_t h = home(slots[j].hash);
+                // Элемент j можно сдвинуть в дыру, если его домашняя ячейка
+                // не лежит циклически в (hole, j].
+                if (((j - h) & mask()) >= ((j - hole) & mask())) {
+                    slots[hole] = slots[j];
+                    hole = j;
+                }
+            }
+            slots[hole] = slot();
+        }
+
+        void renumber(size_t from, size_t to, size_t hash) noexcept {
+            slots[position_of(from, hash)].index = to;
+        }
+
+        // Перестраивает таблицу под capacity ячеек (степень двойки).
+        void rehash(size_t capacity) {
+            std::vector<slot> old(capacity);
+            old.swap(slots);
+            shift = 64;
+            for (size_t c = capacity; c > 1; c >>= 1) {
+                shift--;
+            }
+            for (const slot &s : old) {
+                if (s.index != empty_slot) {
+                    insert(s.index, s.hash);
+                }
+            }
+        }
+    };
+
+    using left_table = index_table<Left, HashLeft, EqualLeft, &entry::left>;
+    using right_table = index_table<Right, HashRight, EqualRight, &entry::right>;
+
+    pair_store store;
+    left_table left_index;
+    right_table right_index;
+
+public:
+    template<typename side>
+    struct iterator {
+        using type = typename std::conditional<std::is_same_v<side, tag_key>, left_t, right_t>::type;
+        using inv_side = typename std::conditional<std::is_same_v<side, tag_key>, tag_value, tag_key>::type;
+
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = type const *;
+        using reference = type const &;
+
+        const pair_store *store;
+        size_t index;
+
+        iterator(const pair_store *store, size_t index) noexcept: store(store), index(index) {}
+
+        type const &operator*() const noexcept {
+            if constexpr (std::is_same_v<side, tag_key>) {
+                return store->data[index].left;
+            } else {
+                return store->data[index].right;
+            }
+        }
+
+        type const *operator->() const noexcept {
+            return &**this;
+        }
+
+        iterator &operator++() noexcept {
+            index--;
+            return *this;
+        }
+
+        iterator operator++(int) noexcept {
+            iterator prev = *this;
+            ++*this;
+            return prev;
+        }
+
+        iterator &operator--() noexcept {
+            index++;
+            return *this;
+        }
+
+        iterator operator--(int) noexcept {
+            iterator prev = *this;
+            --*this;
+            return prev;
+        }
+
+        friend bool operator==(iterator first, iterator second) noexcept {
+            return first.index == second.index;
+        }
+
+        friend bool operator!=(iterator first, iterator second) noexcept {
+            return first.index != second.index;
+        }
+
+        iterator<inv_side> flip() const noexcept {
+            return iterator<inv_side>(store, index);
+        }
+    };
+
+    using left_iterator = iterator<tag_key>;
+    using right_iterator = iterator<tag_value>;
+
+    explicit unordered_bimap(HashLeft hash_left = HashLeft(), HashRight hash_right = HashRight(),
+                             EqualLeft equal_left = EqualLeft(), EqualRight equal_right = EqualRight())
+            : left_index(hash_left, equal_left), right_index(hash_right, equal_right) {}
+
+    unordered_bimap(unordered_bimap const &other)
+            : store(other.store), left_index(other.left_index), right_index(other.right_index) {}
+
+    unordered_bimap(unordered_bimap &&other) noexcept = default;
+
+    unordered_bimap &operator=(unordered_bimap const &other) {
+        if (this != &other) {
+            unordered_bimap copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    unordered_bimap &operator=(unordered_bimap &&other) noexcept {
+        std::swap(store, other.store);
+        std::swap(left_index, other.left_index);
+        std::swap(right_index, other.right_index);
+        return *this;
+    }
+
+    // Вставка пары (left, right), возвращает итератор на left.
+    // Если такой left или такой right уже присутствуют, вставка не
+    // производится и возвращается end_left().
+    left_iterator insert(left_t const &left, right_t const &right) {
+        return emplace(left, right);
+    }
+
+    left_iterator insert(left_t const &left, right_t &&right) {
+        return emplace(left, std::move(right));
+    }
+
+    left_iterator insert(left_t &&left, right_t const &right) {
+        return emplace(std::move(left), right);
+    }
+
+    left_iterator insert(left_t &&left, right_t &&right) {
+        return emplace(std::move(left), std::move(right));
+    }
+
+    // Удаляет пару. Итератор на первую по порядку обхода пару
+    // инвалидируется: она переезжает на место удаленной. Возвращает итератор
+    // на следующую пару, остальные итераторы остаются валидными.
+    left_iterator erase_left(left_iterator it) {
+        remove(it.index);
+        return ++it;
+    }
+
+    right_iterator erase_right(right_iterator it) {
+        remove(it.index);
+        return ++it;
+    }
+
+    bool erase_left(left_t const &left) {
+        return erase_key(left_index, left);
+    }
+
+    bool erase_right(right_t const &right) {
+        return erase_key(right_index, right);
+    }
+
+    left_iterator erase_left(left_iterator first, left_iterator last) {
+        return erase_range(first, last);
+    }
+
+    right_iterator erase_right(right_iterator first, right_iterator last) {
+        return erase_range(first, last);
+    }
+
+    left_iterator find_left(left_t const &left) const {
+        return left_iterator(&store, find_index(left_index, left));
+    }
+
+    right_iterator find_right(right_t const &right) const {
+        return right_iterator(&store, find_index(right_index, right));
+    }
+
+    right_t const &at_left(left_t const &key) const {
+        size_t i = find_index(left_index, key);
+        if (i == empty_slot) {
+            throw std::out_of_range("unordered_bimap::at_left");
+        }
+        return store.data[i].right;
+    }
+
+    left_t const &at_right(right_t const &key) const {
+        size_t i = find_index(right_index, key);
+        if (i == empty_slot) {
+            throw std::out_of_range("unordered_bimap::at_right");
+        }
+        return store.data[i].left;
+    }
+
+    // Как у bimap: если ключа нет, добавляет пару с дефолтным элементом,
+    // предварительно удалив пару, в которой этот дефолтный элемент уже есть.
+    template<typename T, typename = std::enable_if_t<
+            std::is_same_v<T, left_t> &&
+            std::is_default_constructible_v<right_t>>>
+    right_t const &at_left_or_default(T const &key) {
+        size_t i = find_index(left_index, key);
+        if (i != empty_slot) {
+            return store.data[i].right;
+        }
+        right_t default_right = right_t();
+        erase_right(default_right);
+        return *insert(key, std::move(default_right)).flip();
+    }
+
+    template<typename T, typename = std::enable_if_t<
+            std::is_same_v<T, right_t> &&
+            std::is_default_constructible_v<left_t>>>
+    left_t const &at_right_or_default(T const &key) {
+        size_t i = find_index(right_index, key);
+        if (i != empty_slot) {
+            return store.data[i].left;
+        }
+        left_t default_left = left_t();
+        erase_left(default_left);
+        return *insert(std::move(default_left), key);
+    }
+
+    left_iterator begin_left() const noexcept {
+        return left_iterator(&store, size() - 1);
+    }
+
+    left_iterator end_left() const noexcept {
+        return left_iterator(&store, empty_slot);
+    }
+
+    right_iterator begin_right() const noexcept {
+        return right_iterator(&store, size() - 1);
+    }
+
+    right_iterator end_right() const noexcept {
+        return right_iterator(&store, empty_slot);
+    }
+
+    // Готовит место под n пар без перехеширования.
+    void reserve(size_t n) {
+        store.reserve(n);
+        size_t capacity = 8;
+        while (capacity < 2 * n) {
+            capacity *= 2;
+        }
+        if (capacity > left_index.slots.size()) {
+            left_index.rehash(capacity);
+            right_index.rehash(capacity);
+        }
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return store.size == 0;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return store.size;
+    }
+
+    // Пары равны как множества, порядок обхода не важен.
+    friend bool operator==(unordered_bimap const &a, unordered_bimap const &b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            auto it = b.find_left(a.store.data[i].left);
+            if (it == b.end_left() || !b.right_index.equal(*it.flip(), a.store.data[i].right)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(unordered_bimap const &a, unordered_bimap const &b) {
+        return !(a == b);
+    }
+
+private:
+    template<typename Table, typename T>
+    size_t find_index(const Table &table, const T &key) const {
+        return table.find(store, key, table.hash_of(key));
+    }
+
+    template<typename L, typename R>
+    left_iterator emplace(L &&left, R &&right) {
+        size_t hash_left = left_index.hash_of(left);
+        size_t hash_right = right_index.hash_of(right);
+        if (left_index.find(store, left, hash_left) != empty_slot ||
+            right_index.find(store, right, hash_right) != empty_slot) {
+            return end_left();
+        }
+        if (2 * (size() + 1) > left_index.slots.size()) {
+            size_t capacity = left_index.slots.empty() ? 16 : 2 * left_index.slots.size();
+            left_index.rehash(capacity);
+            right_index.rehash(capacity);
+        }
+        store.push_back(std::forward<L>(left), std::forward<R>(right));
+        size_t index = size() - 1;
+        left_index.insert(index, hash_left);
+        right_index.insert(index, hash_right);
+        return left_iterator(&store, index);
+    }
+
+    void remove(size_t index) {
+        size_t last = size() - 1;
+        entry &e = store.data[index];
+        left_index.erase(index, left_index.hash_of(e.left));
+        right_index.erase(index, right_index.hash_of(e.right));
+        if (index != last) {
+            entry &moved = store.data[last];
+            left_index.renumber(last, index, left_index.hash_of(moved.left));
+            right_index.renumber(last, index, right_index.hash_of(moved.right));
+        }
+        store.remove(index);
+    }
+
+    template<typename Table, typename T>
+    bool erase_key(const Table &table, const T &key) {
+        size_t i = find_index(table, key);
+        if (i == empty_slot) {
+            return false;
+        }
+        remove(i);
+        return true;
+    }
+
+    // Диапазон занимает индексы (last.index, first.index]. Удаляем сверху
+    // вниз: на место i переезжает пара с индексом больше first.index, то есть
+    // уже пройденная, а пары за last не трогаются.
+    template<typename It>
+    It erase_range(It first, It last) {
+        for (size_t i = first.index; i != last.index; i--) {
+            remove(i);
+        }
+        return last;
+    }
+};